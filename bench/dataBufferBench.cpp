@@ -0,0 +1,121 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// =============================================================================
+//
+// Times the ways the compiler fills data buffers: many small writes into one
+// buffer, many small expression buffers merged into one, and long strings.
+// Built with -DBOTC_BUILD_BENCH=ON as botc_bench.
+//
+
+#include <chrono>
+#include <cstdio>
+#include "main.h"
+#include "arena.h"
+#include "dataBuffer.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// _________________________________________________________________________________________________
+//
+// Returns the milliseconds since the given time.
+//
+static double millisecondsSince (Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli> (Clock::now() - start).count();
+}
+
+// _________________________________________________________________________________________________
+//
+// Writes 4M dwords, 16 MB in all, into one buffer.
+//
+static void benchWriteDWord()
+{
+	Clock::time_point start = Clock::now();
+	DataBufferPtr buffer = DataBuffer::Create();
+
+	for (int i = 0; i < 4000000; ++i)
+		buffer->writeDWord (i);
+
+	printf ("4M writeDWord:                  %8.1f ms\n", millisecondsSince (start));
+}
+
+// _________________________________________________________________________________________________
+//
+// Merges 300k buffers of 8 bytes, like the operands of expressions, into one.
+//
+static void benchMergeSmallBuffers()
+{
+	Clock::time_point start = Clock::now();
+	DataBufferPtr parent = DataBuffer::Create();
+
+	for (int i = 0; i < 300000; ++i)
+	{
+		DataBufferPtr operand = DataBuffer::Create (8);
+		operand->writeHeader (DataHeader::PushLocalVar);
+		operand->writeDWord (i);
+		parent->mergeAndDestroy (std::move (operand));
+	}
+
+	printf ("300k 8-byte buffers merged:     %8.1f ms\n", millisecondsSince (start));
+}
+
+// _________________________________________________________________________________________________
+//
+// Writes 100k strings of 100 characters into one buffer.
+//
+static void benchWriteString()
+{
+	String text;
+
+	for (int i = 0; i < 100; ++i)
+		text += char ('a' + i % 26);
+
+	Clock::time_point start = Clock::now();
+	DataBufferPtr buffer = DataBuffer::Create();
+
+	for (int i = 0; i < 100000; ++i)
+		buffer->writeString (text);
+
+	printf ("100k writeString, 100 chars:    %8.1f ms\n", millisecondsSince (start));
+}
+
+// _________________________________________________________________________________________________
+//
+int main()
+{
+	Arena arena;
+	benchWriteDWord();
+	benchMergeSmallBuffers();
+	benchWriteString();
+	return EXIT_SUCCESS;
+}
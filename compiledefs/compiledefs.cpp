@@ -0,0 +1,513 @@
+/*
+	Copyright 2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// =============================================================================
+//
+// Compiles the funcdef, builtindef and eventdef statements of a definitions
+// file (botc_defs.bts) into constant tables that botc loads at startup, so that
+// the definitions do not need to be lexed and parsed for every compile. The
+// tables come with the size and FNV-1a hash of the file so that botc can tell
+// when a script includes the very same file.
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <ciso646>
+
+using std::string;
+using std::vector;
+
+static int LineNumber;
+static std::string CurrentFile;
+
+// =============================================================================
+//
+void Error (const char* fmt, ...)
+{
+	char buf[1024];
+	va_list va;
+	va_start (va, fmt);
+	vsnprintf (buf, sizeof buf, fmt, va);
+	va_end (va);
+	throw std::string (buf);
+}
+
+// =============================================================================
+//
+struct ArgumentInfo
+{
+	string	type;
+	string	name;
+	long	defvalue;
+};
+
+struct CommandInfo
+{
+	string					name;
+	long					number;
+	string					returnvalue;
+	int						minargs;
+	vector<ArgumentInfo>	args;
+	bool					isbuiltin;
+};
+
+struct EventInfo
+{
+	string	name;
+	long	number;
+};
+
+// =============================================================================
+//
+// Must match the hash in src/builtinDefinitions.cpp
+//
+uint64_t HashSource (const string& data)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (unsigned char ch : data)
+	{
+		hash ^= ch;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// =============================================================================
+//
+string TypeEnumerator (const string& type)
+{
+	if (type == "int")
+		return "TYPE_Int";
+	else if (type == "str")
+		return "TYPE_String";
+	else if (type == "bool")
+		return "TYPE_Bool";
+	else if (type == "void")
+		return "TYPE_Void";
+
+	Error ("unknown type '%s'", type.c_str());
+	return "";
+}
+
+// =============================================================================
+//
+// Splits the definitions into symbols, numbers and single-character tokens,
+// skipping whitespace, comments and the #!botc header line.
+//
+class DefinitionReader
+{
+	const string&	_data;
+	size_t			_pos;
+	string			_token;
+
+public:
+	DefinitionReader (const string& data) :
+		_data (data),
+		_pos (0)
+	{
+		if (_data.compare (0, 2, "#!") == 0)
+		{
+			while (_pos < _data.size() and _data[_pos] != '\n')
+				++_pos;
+		}
+	}
+
+	bool next()
+	{
+		skipWhitespace();
+
+		if (_pos >= _data.size())
+			return false;
+
+		size_t start = _pos;
+		char ch = _data[_pos];
+
+		if (isalpha (ch) or ch == '_')
+		{
+			while (_pos < _data.size() and (isalnum (_data[_pos]) or _data[_pos] == '_'))
+				++_pos;
+		}
+		else if (isdigit (ch))
+		{
+			while (_pos < _data.size() and isdigit (_data[_pos]))
+				++_pos;
+		}
+		else if (strchr (":(),;=", ch) != nullptr)
+			++_pos;
+		else
+			Error ("unexpected character '%c'", ch);
+
+		_token = _data.substr (start, _pos - start);
+		return true;
+	}
+
+	void mustGetNext()
+	{
+		if (not next())
+			Error ("unexpected end of file");
+	}
+
+	void mustGetSymbol (const char* symbol)
+	{
+		mustGetNext();
+
+		if (_token != symbol)
+			Error ("expected '%s', got '%s'", symbol, _token.c_str());
+	}
+
+	string mustGetName()
+	{
+		mustGetNext();
+
+		if (not isalpha (_token[0]) and _token[0] != '_')
+			Error ("expected a name, got '%s'", _token.c_str());
+
+		return _token;
+	}
+
+	long mustGetNumber()
+	{
+		mustGetNext();
+
+		if (not isdigit (_token.back()))
+			Error ("expected a number, got '%s'", _token.c_str());
+
+		return strtol (_token.c_str(), nullptr, 10);
+	}
+
+	bool peekSymbol (const char* symbol)
+	{
+		skipWhitespace();
+		return _data.compare (_pos, strlen (symbol), symbol) == 0;
+	}
+
+	const string& token() const
+	{
+		return _token;
+	}
+
+private:
+	char peek (size_t offset) const
+	{
+		return (_pos + offset < _data.size()) ? _data[_pos + offset] : '\0';
+	}
+
+	void skipWhitespace()
+	{
+		for (;;)
+		{
+			while (_pos < _data.size() and isspace (_data[_pos]))
+			{
+				if (_data[_pos] == '\n')
+					LineNumber++;
+
+				++_pos;
+			}
+
+			if (peek (0) == '/' and peek (1) == '/')
+			{
+				while (_pos < _data.size() and _data[_pos] != '\n')
+					++_pos;
+			}
+			else if (peek (0) == '/' and peek (1) == '*')
+			{
+				size_t end = _data.find ("*/", _pos + 2);
+
+				if (end == string::npos)
+					Error ("unterminated comment");
+
+				LineNumber += std::count (_data.begin() + _pos, _data.begin() + end, '\n');
+				_pos = end + 2;
+			}
+			else
+				break;
+		}
+	}
+};
+
+// =============================================================================
+//
+CommandInfo ReadFuncdef (DefinitionReader& reader, bool isbuiltin)
+{
+	CommandInfo comm;
+	comm.isbuiltin = isbuiltin;
+	comm.returnvalue = reader.mustGetName();
+	TypeEnumerator (comm.returnvalue);
+	comm.number = reader.mustGetNumber();
+	reader.mustGetSymbol (":");
+	comm.name = reader.mustGetName();
+	reader.mustGetSymbol ("(");
+	comm.minargs = 0;
+
+	while (not reader.peekSymbol (")"))
+	{
+		if (not comm.args.empty())
+			reader.mustGetSymbol (",");
+
+		ArgumentInfo arg;
+		arg.type = reader.mustGetName();
+		arg.defvalue = 0;
+
+		if (arg.type == "void")
+			Error ("arguments cannot be void");
+
+		TypeEnumerator (arg.type);
+		arg.name = reader.mustGetName();
+
+		// Once an argument has a default value, the rest of them need one as well.
+		if (comm.minargs < int (comm.args.size()) or reader.peekSymbol ("="))
+		{
+			reader.mustGetSymbol ("=");
+
+			if (arg.type == "str")
+				Error ("string arguments cannot have default values");
+
+			arg.defvalue = reader.mustGetNumber();
+		}
+		else
+			comm.minargs++;
+
+		comm.args.push_back (arg);
+	}
+
+	reader.mustGetSymbol (")");
+	reader.mustGetSymbol (";");
+	return comm;
+}
+
+// =============================================================================
+//
+EventInfo ReadEventdef (DefinitionReader& reader)
+{
+	EventInfo e;
+	e.number = reader.mustGetNumber();
+	reader.mustGetSymbol (":");
+	e.name = reader.mustGetName();
+	reader.mustGetSymbol ("(");
+	reader.mustGetSymbol (")");
+	reader.mustGetSymbol (";");
+	return e;
+}
+
+// =============================================================================
+//
+string BaseName (const string& filepath)
+{
+	size_t slash = filepath.find_last_of ("/\\");
+	return (slash == string::npos) ? filepath : filepath.substr (slash + 1);
+}
+
+// =============================================================================
+//
+// Writes the file only if its contents change, so that the tables are not
+// compiled again on every build.
+//
+void WriteIfChanged (const string& filepath, const string& contents)
+{
+	FILE* readhandle = fopen (filepath.c_str(), "rb");
+
+	if (readhandle)
+	{
+		string old;
+		char buf[4096];
+		size_t len;
+
+		while ((len = fread (buf, 1, sizeof buf, readhandle)) > 0)
+			old.append (buf, len);
+
+		fclose (readhandle);
+
+		if (old == contents)
+			return;
+	}
+
+	FILE* handle = fopen (filepath.c_str(), "wb");
+
+	if (not handle)
+		Error ("couldn't open %s for writing", filepath.c_str());
+
+	fwrite (contents.c_str(), 1, contents.size(), handle);
+	fclose (handle);
+	fprintf (stdout, "Wrote output file %s.\n", filepath.c_str());
+}
+
+// =============================================================================
+//
+int main (int argc, char* argv[])
+{
+	try
+	{
+		if (argc != 3)
+		{
+			fprintf (stderr, "usage: %s input output\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		FILE* fp = fopen (argv[1], "rb");
+
+		if (fp == nullptr)
+			Error ("could not open %s for reading: %s", argv[1], strerror (errno));
+
+		string data;
+		char buf[4096];
+		size_t len;
+
+		while ((len = fread (buf, 1, sizeof buf, fp)) > 0)
+			data.append (buf, len);
+
+		fclose (fp);
+		CurrentFile = argv[1];
+		LineNumber = 1;
+
+		vector<CommandInfo> commands;
+		vector<EventInfo> events;
+		DefinitionReader reader (data);
+
+		while (reader.next())
+		{
+			if (reader.token() == "funcdef" or reader.token() == "builtindef")
+			{
+				CommandInfo comm = ReadFuncdef (reader, reader.token() == "builtindef");
+
+				for (const CommandInfo& other : commands)
+				{
+					if (other.number == comm.number and other.isbuiltin == comm.isbuiltin)
+					{
+						Error ("command #%ld (%s) is defined again as %s", comm.number,
+							other.name.c_str(), comm.name.c_str());
+					}
+				}
+
+				commands.push_back (comm);
+			}
+			else if (reader.token() == "eventdef")
+			{
+				EventInfo e = ReadEventdef (reader);
+
+				for (const EventInfo& other : events)
+				{
+					if (other.number == e.number)
+					{
+						Error ("event #%ld (%s) is defined again as %s", e.number,
+							other.name.c_str(), e.name.c_str());
+					}
+				}
+
+				events.push_back (e);
+			}
+			else if (reader.token() != ";")
+				Error ("'%s' is not allowed in a definitions file", reader.token().c_str());
+		}
+
+		CurrentFile = "";
+		string source = "// Generated from " + BaseName (argv[1]) + " by compiledefs, do not edit.\n"
+			"#include \"builtinDefinitions.h\"\n\n";
+
+		source += "static constexpr BuiltinArgument Arguments[] =\n{\n";
+		size_t numArguments = 0;
+
+		for (const CommandInfo& comm : commands)
+		{
+			for (const ArgumentInfo& arg : comm.args)
+			{
+				source += "\t{" + TypeEnumerator (arg.type) + ", \"" + arg.name + "\", "
+					+ std::to_string (arg.defvalue) + "},\n";
+				numArguments++;
+			}
+		}
+
+		if (numArguments == 0)
+			source += "\t{TYPE_Unknown, \"\", 0},\n";
+
+		source += "};\n\nstatic constexpr BuiltinCommand Commands[] =\n{\n";
+		size_t firstArgument = 0;
+
+		for (const CommandInfo& comm : commands)
+		{
+			source += "\t{\"" + comm.name + "\", " + std::to_string (comm.number) + ", "
+				+ TypeEnumerator (comm.returnvalue) + ", " + std::to_string (comm.minargs) + ", "
+				+ std::to_string (firstArgument) + ", " + std::to_string (comm.args.size()) + ", "
+				+ (comm.isbuiltin ? "true" : "false") + "},\n";
+			firstArgument += comm.args.size();
+		}
+
+		if (commands.empty())
+			source += "\t{\"\", -1, TYPE_Unknown, 0, 0, 0, false},\n";
+
+		source += "};\n\nstatic constexpr BuiltinEvent Events[] =\n{\n";
+
+		for (const EventInfo& e : events)
+		{
+			source += "\t{\"" + e.name + "\", " + std::to_string (e.number) + "},\n";
+		}
+
+		if (events.empty())
+			source += "\t{\"\", -1},\n";
+
+		source += "};\n\n";
+		source += "extern const BuiltinDefinitions BuiltinDefs =\n{\n"
+			"\tCommands, " + std::to_string (commands.size()) + ",\n"
+			"\tArguments,\n"
+			"\tEvents, " + std::to_string (events.size()) + ",\n"
+			"\t" + std::to_string (data.size()) + ",\n"
+			"\t" + std::to_string (HashSource (data)) + "ull,\n"
+			"};\n";
+
+		WriteIfChanged (argv[2], source);
+	}
+	catch (std::string a)
+	{
+		if (CurrentFile.size() > 0)
+		{
+			fprintf (stderr, "%s: %s:%d: error: %s\n",
+				argv[0], CurrentFile.c_str(), LineNumber, a.c_str());
+		}
+		else
+		{
+			fprintf (stderr, "%s: error: %s\n", argv[0], a.c_str());
+		}
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
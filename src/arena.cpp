@@ -0,0 +1,144 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <cstdlib>
+#include "arena.h"
+#include "builtinDefinitions.h"
+#include "commands.h"
+#include "dataBuffer.h"
+#include "events.h"
+#include "stringTable.h"
+
+static Arena* CurrentArena = null;
+
+// _________________________________________________________________________________________________
+//
+Arena::Arena() :
+	m_position (null),
+	m_end (null),
+	m_previous (CurrentArena)
+{
+	CurrentArena = this;
+}
+
+// _________________________________________________________________________________________________
+//
+Arena::~Arena()
+{
+	clear();
+	ASSERT_EQ (CurrentArena, this);
+	CurrentArena = m_previous;
+}
+
+// _________________________________________________________________________________________________
+//
+Arena* Arena::Current()
+{
+	ASSERT_NE (CurrentArena, null);
+	return CurrentArena;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns the given amount of memory, aligned as asked. Requests that would take up a good part of
+//	a block get a block of their own, so that the rest of the current block is not wasted.
+//
+void* Arena::allocate (size_t size, size_t alignment)
+{
+	uintptr_t position = reinterpret_cast<uintptr_t> (m_position);
+	uintptr_t aligned = (position + alignment - 1) & ~(uintptr_t (alignment) - 1);
+
+	if (m_position != null and aligned + size <= reinterpret_cast<uintptr_t> (m_end))
+	{
+		m_position = reinterpret_cast<char*> (aligned + size);
+		return reinterpret_cast<char*> (aligned);
+	}
+
+	if (size > BlockSize / 4)
+	{
+		// malloc aligns for any fundamental type.
+		char* block = static_cast<char*> (malloc (size));
+
+		if (block == null)
+			throw std::bad_alloc();
+
+		m_blocks.push_back (block);
+		return block;
+	}
+
+	char* block = static_cast<char*> (malloc (BlockSize));
+
+	if (block == null)
+		throw std::bad_alloc();
+
+	m_blocks.push_back (block);
+	m_position = block + size;
+	m_end = block + BlockSize;
+	return block;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Destroys everything that was created in the arena and frees its memory. The outermost arena
+//	holds the compilation, so clearing it also resets the tables that point into it.
+//
+void Arena::clear()
+{
+	if (m_previous == null)
+		resetCompilation();
+
+	for (auto it = m_cleanups.rbegin(); it != m_cleanups.rend(); ++it)
+		it->destroy (it->object);
+
+	for (char* block : m_blocks)
+		free (block);
+
+	m_cleanups.clear();
+	m_blocks.clear();
+	m_position = null;
+	m_end = null;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Forgets the definitions, strings, marks and references of the compilation. These point into the
+//	arena, so this is done when the arena that holds them is cleared.
+//
+void resetCompilation()
+{
+	clearCommandDefinitions();
+	clearEvents();
+	clearStringTable();
+	forgetLoadedDefinitions();
+	DataBuffer::ClearTables();
+}
@@ -0,0 +1,125 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BOTC_ARENA_H
+#define BOTC_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "main.h"
+
+// _________________________________________________________________________________________________
+//
+//	The Arena class hands out memory for the objects that live as long as a compilation does:
+//	variables, command and event definitions, expression values, data buffers and their marks and
+//	references. Memory is bumped off large blocks and is only given back all at once, when the
+//	arena is cleared or destroyed. Objects that need their destructor run are remembered and
+//	destroyed then, in reverse order of creation.
+//
+//	The arena that was constructed last is the current one, and create() allocates from it. The
+//	previous arena becomes current again once the newer one is destroyed.
+//
+class Arena
+{
+	DELETE_COPY (Arena)
+
+public:
+	Arena();
+	~Arena();
+
+	void*			allocate (size_t size, size_t alignment);
+	void			clear();
+
+	template<typename T, typename... Args>
+	T*				make (Args&&... args);
+
+	static Arena*	Current();
+
+private:
+	struct Cleanup
+	{
+		void*		object;
+		void		(*destroy) (void*);
+	};
+
+	static constexpr size_t BlockSize = 64 * 1024;
+
+	std::vector<char*>		m_blocks;
+	std::vector<Cleanup>	m_cleanups;
+	char*					m_position;
+	char*					m_end;
+	Arena*					m_previous;
+
+	template<typename T>
+	static void				Destroy (void* object);
+};
+
+void resetCompilation();
+
+// _________________________________________________________________________________________________
+//
+//	Constructs a T in the arena. Its destructor is run when the arena is cleared.
+//
+template<typename T, typename... Args>
+T* Arena::make (Args&&... args)
+{
+	T* object = new (allocate (sizeof (T), alignof (T))) T (std::forward<Args> (args)...);
+
+	if (not std::is_trivially_destructible<T>::value)
+		m_cleanups.push_back ({object, &Destroy<T>});
+
+	return object;
+}
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+void Arena::Destroy (void* object)
+{
+	static_cast<T*> (object)->~T();
+}
+
+// _________________________________________________________________________________________________
+//
+//	Constructs a T in the current arena.
+//
+template<typename T, typename... Args>
+inline T* create (Args&&... args)
+{
+	return Arena::Current()->make<T> (std::forward<Args> (args)...);
+}
+
+#endif // BOTC_ARENA_H
@@ -0,0 +1,141 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "builtinDefinitions.h"
+#include "arena.h"
+#include "commands.h"
+#include "events.h"
+#include "parser.h"
+#include "sourceBuffer.h"
+
+// Size and hash of the definitions file that was loaded, if any.
+static long		LoadedSourceSize = -1;
+static uint64_t	LoadedSourceHash = 0;
+
+// _________________________________________________________________________________________________
+//
+//	FNV-1a hash of the given data. This must match the hash that compiledefs writes.
+//
+static uint64_t hashSource (const char* data, long size)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (long i = 0; i < size; ++i)
+	{
+		hash ^= uint8_t (data[i]);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Defines the commands and events that were compiled into botc.
+//
+void loadBuiltinDefinitions()
+{
+	for (int i = 0; i < BuiltinDefs.numCommands; ++i)
+	{
+		const BuiltinCommand& def = BuiltinDefs.commands[i];
+		CommandInfo* comm = create<CommandInfo>();
+		comm->name = def.name;
+		comm->number = def.number;
+		comm->minargs = def.minargs;
+		comm->returnvalue = def.returnvalue;
+		comm->origin.file = 0;
+		comm->origin.offset = 0;
+		comm->isbuiltin = def.isbuiltin;
+		comm->ispreloaded = true;
+
+		for (int j = 0; j < def.numArguments; ++j)
+		{
+			const BuiltinArgument& argdef = BuiltinDefs.arguments[def.firstArgument + j];
+			CommandArgument arg;
+			arg.type = argdef.type;
+			arg.name = argdef.name;
+			arg.defvalue = argdef.defvalue;
+			comm->args << arg;
+		}
+
+		addCommandDefinition (comm);
+	}
+
+	for (int i = 0; i < BuiltinDefs.numEvents; ++i)
+	{
+		EventDefinition* e = create<EventDefinition>();
+		e->name = BuiltinDefs.events[i].name;
+		e->number = BuiltinDefs.events[i].number;
+		e->ispreloaded = true;
+		addEvent (e);
+	}
+
+	LoadedSourceSize = BuiltinDefs.sourceSize;
+	LoadedSourceHash = BuiltinDefs.sourceHash;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Defines the commands and events of the given definitions file instead of the compiled ones.
+//
+void loadDefinitionsFile (const String& fileName)
+{
+	BotscriptParser parser;
+	parser.setReadOnly (true);
+	parser.parseBotscript (fileName);
+
+	SourceBuffer source (fileName);
+	LoadedSourceSize = source.size();
+	LoadedSourceHash = hashSource (source.begin(), source.size());
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns whether the given source has the definitions that were loaded, so that including it
+//	would define everything again.
+//
+bool isLoadedDefinitionsFile (const SourceBuffer& source)
+{
+	return source.size() == LoadedSourceSize
+		and hashSource (source.begin(), source.size()) == LoadedSourceHash;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Forgets which definitions were loaded.
+//
+void forgetLoadedDefinitions()
+{
+	LoadedSourceSize = -1;
+	LoadedSourceHash = 0;
+}
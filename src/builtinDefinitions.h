@@ -0,0 +1,88 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BOTC_BUILTINDEFINITIONS_H
+#define BOTC_BUILTINDEFINITIONS_H
+
+#include "main.h"
+
+class SourceBuffer;
+
+// _________________________________________________________________________________________________
+//
+//	The commands and events of botc_defs.bts, compiled into tables by compiledefs when botc is
+//	built.
+//
+struct BuiltinArgument
+{
+	DataType		type;
+	const char*		name;
+	int				defvalue;
+};
+
+struct BuiltinCommand
+{
+	const char*		name;
+	int				number;
+	DataType		returnvalue;
+	int				minargs;
+	int				firstArgument;
+	int				numArguments;
+	bool			isbuiltin;
+};
+
+struct BuiltinEvent
+{
+	const char*		name;
+	int				number;
+};
+
+struct BuiltinDefinitions
+{
+	const BuiltinCommand*	commands;
+	int						numCommands;
+	const BuiltinArgument*	arguments;
+	const BuiltinEvent*		events;
+	int						numEvents;
+	long					sourceSize;
+	uint64_t				sourceHash;
+};
+
+extern const BuiltinDefinitions BuiltinDefs;
+
+void	loadBuiltinDefinitions();
+void	loadDefinitionsFile (const String& fileName);
+bool	isLoadedDefinitionsFile (const SourceBuffer& source);
+void	forgetLoadedDefinitions();
+
+#endif // BOTC_BUILTINDEFINITIONS_H
@@ -86,18 +86,18 @@ StringList CommandLine::process (int const argc, char* argv[])
 					// Bool options need no parameters
 					option->handleValue ("");
 				}
+				elif (i != arg.length() - 1)
+				{
+					// The rest of the argument is the parameter, as in -O1
+					option->handleValue (arg.mid (i + 1));
+					break;
+				}
 				else
 				{
 					// Ensure we got a valid parameter coming up
 					if (argn == argc - 1)
 						error ("option -%1 requires a parameter", option->describe());
 
-					if (i != arg.length() - 1)
-					{
-						error ("option %1 requires a parameter but has option -%2 stacked on",
-							option->describe(), arg[i + 1]);
-					}
-
 					option->handleValue (argv[++argn]);
 				}
 			}
@@ -214,7 +214,7 @@ void CommandLineOption::handleValue (const String& a)
 	elif (isOfType<int>())
 	{
 		bool ok;
-		pointer().setValue (a.toLong (&ok));
+		pointer().setValue (int (a.toLong (&ok)));
 
 		if (not ok)
 			error ("bad integral value passed to %1", describe());
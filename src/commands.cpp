@@ -36,38 +36,87 @@
 #include "main.h"
 #include "stringClass.h"
 #include "commands.h"
+#include "registry.h"
 #include "lexer.h"
 
 static List<CommandInfo*> Commands;
+static Registry<CommandInfo> CommandRegistry;
+
+// _________________________________________________________________________________________________
+//
+// Commands and builtins are numbered separately, so both go into the number table of the registry
+// under their own keys.
+//
+static int commandKey (const CommandInfo* comm)
+{
+	return comm->number * 2 + (comm->isbuiltin ? 1 : 0);
+}
+
+// _________________________________________________________________________________________________
+//
+// Drops the given command that was loaded up front, for the script to define it in its own way.
+//
+static void dropPreloadedCommand (CommandInfo* comm)
+{
+	Commands.removeOne (comm);
+	CommandRegistry.clear();
+
+	for (CommandInfo* other : Commands)
+	{
+		CommandRegistry.insertNumber (other, commandKey (other));
+		CommandRegistry.insert (other, other->name);
+	}
+}
 
 // _________________________________________________________________________________________________
 //
 void addCommandDefinition (CommandInfo* comm)
 {
-	// Ensure that there is no conflicts
-	for (CommandInfo* it : Commands)
+	CommandInfo* it = CommandRegistry.findByNumber (commandKey (comm));
+
+	// Defining the very same command again is let through, as scripts may include a copy of the
+	// definitions that were loaded up front.
+	if (it != null and it->name == comm->name and it->signature() == comm->signature())
+		return;
+
+	// A script may also include definitions of its own that differ from the loaded ones, such as
+	// an edited copy of them. Those are used in place of the loaded commands of the same number
+	// or name.
+	if (it != null and it->ispreloaded)
 	{
-		if (it->number == comm->number && it->isbuiltin == comm->isbuiltin)
-		{
-			error ("Attempted to redefine command #%1 (%2) as %3",
-				   Commands[comm->number]->name, comm->name);
-		}
+		dropPreloadedCommand (it);
+		it = null;
 	}
 
+	CommandInfo* samename = CommandRegistry.find (comm->name);
+
+	if (samename != null and samename->ispreloaded)
+		dropPreloadedCommand (samename);
+
+	// Ensure that there is no conflicts.
+	if (it != null)
+	{
+		error ("Attempted to redefine command #%1 (%2) as %3",
+			   comm->number, it->signature(), comm->signature());
+	}
+
+	CommandRegistry.insertNumber (comm, commandKey (comm));
+	CommandRegistry.insert (comm, comm->name);
 	Commands << comm;
 }
 
 // _________________________________________________________________________________________________
 // Finds a command by name
-CommandInfo* findCommandByName (String fname)
+CommandInfo* findCommandByName (const char* name, int length)
 {
-	for (CommandInfo* comm : Commands)
-	{
-		if (fname.toUppercase() == comm->name.toUppercase())
-			return comm;
-	}
+	return CommandRegistry.find (name, length);
+}
 
-	return null;
+// _________________________________________________________________________________________________
+//
+CommandInfo* findCommandByName (const String& name)
+{
+	return CommandRegistry.find (name);
 }
 
 // _________________________________________________________________________________________________
@@ -129,3 +178,13 @@ const List<CommandInfo*>& getCommands()
 {
 	return Commands;
 }
+
+// _________________________________________________________________________________________________
+//
+// Forgets all command definitions. They belong to the arena, which frees them.
+//
+void clearCommandDefinitions()
+{
+	Commands.clear();
+	CommandRegistry.clear();
+}
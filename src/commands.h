@@ -50,15 +50,18 @@ struct CommandInfo
 	int						minargs;
 	DataType				returnvalue;
 	List<CommandArgument>	args;
-	String					origin;
+	SourceLocation			origin;
 	bool					isbuiltin;
+	bool					ispreloaded;
 
 	String	signature();
 };
 
 void						addCommandDefinition (CommandInfo* comm);
 
-CommandInfo*				findCommandByName (String a);
+CommandInfo*				findCommandByName (const char* name, int length);
+CommandInfo*				findCommandByName (const String& name);
 const List<CommandInfo*>&	getCommands();
+void						clearCommandDefinitions();
 
 #endif // BOTC_COMMANDS_H
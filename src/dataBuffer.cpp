@@ -31,133 +31,441 @@
 */
 
 #include <cstring>
+#include <unordered_set>
+#include <vector>
 #include "dataBuffer.h"
+#include "arena.h"
+#include "objectWriter.h"
+#include "optimizer.h"
 
 // _________________________________________________________________________________________________
 //
-DataBuffer::DataBuffer (int size) :
-	m_buffer (new char[size]),
-	m_allocatedSize (size),
-	m_position (&buffer()[0]) {}
+//	The relocation table: the positions of the marks, indexed by mark, and the references to them.
+//	Once a mark is flushed its chunk is null and the offset is its position in the output. A
+//	reference is dropped from the table once it is flushed; if its mark was not flushed yet, it
+//	becomes a fixup that patches the output file later.
+//
+//	The pushes of strings are kept in the same way, as the slots of the strings in the string table
+//	are only known once the bytecode that pushes them is flushed.
+//
+struct MarkPosition
+{
+	DataChunk*	chunk;
+	int			offset;
+};
+
+struct Relocation
+{
+	DataChunk*	chunk;
+	int			offset;
+	ByteMark	mark;
+};
+
+struct Fixup
+{
+	int			position;
+	ByteMark	mark;
+};
+
+struct StringRelocation
+{
+	DataChunk*	chunk;
+	int			offset;
+	int			number;
+};
+
+static std::vector<MarkPosition> MarkPositions;
+static std::vector<Relocation> Relocations;
+static std::vector<Fixup> Fixups;
+static std::vector<StringRelocation> StringRelocations;
+
+// Marks that were not flushed when they were last looked at. Marks from NumCheckedMarks onwards
+// have not been looked at yet.
+static std::vector<ByteMark> PendingMarks;
+static size_t NumCheckedMarks = 0;
+
+// Flushed chunks of the largest size, which new chunks of that size are taken from.
+static DataChunk* SpareChunks = null;
 
 // _________________________________________________________________________________________________
 //
-DataBuffer::~DataBuffer()
+//	Stores the given value at the given address in little-endian byte order, which is what the
+//	bytecode uses. On little-endian hosts this is a plain unaligned store.
+//
+template<typename T>
+static inline void storeLittleEndian (char* dest, T data)
 {
-	ASSERT (marks().isEmpty());
-	ASSERT (references().isEmpty());
-	delete buffer();
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	std::memcpy (dest, &data, sizeof data);
+#else
+	for (size_t i = 0; i < sizeof data; ++i)
+		dest[i] = (data >> (i * 8)) & 0xFF;
+#endif
 }
 
 // _________________________________________________________________________________________________
 //
-//	Copies the contents of the given buffer into this buffer. The other buffer's marks and 
-//	references will be moved along and the buffer is then destroyed.
+//	The size is that of the first chunk, which is only allocated once something is written.
 //
-void DataBuffer::mergeAndDestroy (DataBuffer* other)
-{
-	if (other == null)
-		return;
+DataBuffer::DataBuffer (int size) :
+	m_firstChunk (null),
+	m_lastChunk (null),
+	m_writtenSize (0),
+	m_chunkSize (size) {}
 
-	// Note: We transfer the marks before the buffer is copied, so that the
-	// offset uses the proper value (which is the written size of @other, which
-	// we don't want our written size to be added to yet).
-	other->transferMarksTo (this);
-	copyBuffer (other);
-	delete other;
+// _________________________________________________________________________________________________
+//
+DataBufferPtr DataBuffer::Create (int size)
+{
+	return DataBufferPtr (create<DataBuffer> (size));
 }
 
 // _________________________________________________________________________________________________
 //
-//	Clones this databuffer to a new one and returns it. Note that the original transfers its marks
-//	and references and loses them in the process.
+//	Forgets all marks, references and spare chunks. The chunks belong to the arena, which frees
+//	them, so this must be done whenever the arena is.
 //
-DataBuffer* DataBuffer::clone()
+void DataBuffer::ClearTables()
 {
-	DataBuffer* other = new DataBuffer;
-	transferMarksTo (other);
-	other->copyBuffer (this);
-	return other;
+	MarkPositions.clear();
+	Relocations.clear();
+	Fixups.clear();
+	StringRelocations.clear();
+	PendingMarks.clear();
+	NumCheckedMarks = 0;
+	SpareChunks = null;
 }
 
-// ============================================================================
+// _________________________________________________________________________________________________
 //
-void DataBuffer::copyBuffer (const DataBuffer* buf)
+void DataBufferReleaser::operator() (DataBuffer* buffer) const
 {
-	checkSpace (buf->writtenSize());
-	memcpy (m_position, buf->buffer(), buf->writtenSize());
-	m_position += buf->writtenSize();
+	buffer->release();
 }
 
-// ============================================================================
+// _________________________________________________________________________________________________
 //
-void DataBuffer::transferMarksTo (DataBuffer* dest)
+//	Empties a buffer that is no longer needed. The chunks, like the buffer object itself, belong to
+//	the compilation's arena and are freed along with it. References that were written into the
+//	buffer are left out of the output.
+//
+void DataBuffer::release()
 {
-	int offset = dest->writtenSize();
+	m_firstChunk = null;
+	m_lastChunk = null;
+	m_writtenSize = 0;
+}
 
-	for (ByteMark* mark : marks())
-	{
-		mark->pos += offset;
-		dest->m_marks << mark;
-	}
+// _________________________________________________________________________________________________
+//
+//	Appends the contents of the given buffer to this buffer. The other buffer is then released.
+//
+void DataBuffer::mergeAndDestroy (DataBufferPtr other)
+{
+	if (other == null or other->firstChunk() == null)
+		return;
 
-	for (MarkReference* ref : references())
+	if (other->writtenSize() <= CopyLimit)
 	{
-		ref->pos += offset;
-		dest->m_references << ref;
+		// Small buffers, such as most expression operands, are copied into our last chunk. This
+		// keeps the list of chunks short. The marks and references in the copied chunks are found
+		// through the chunks once they are resolved.
+		checkSpace (other->writtenSize());
+		DataChunk* dest = lastChunk();
+
+		for (DataChunk* chunk = other->firstChunk(); chunk != null; chunk = chunk->next)
+		{
+			chunk->movedTo = dest;
+			chunk->base = dest->size;
+			std::memcpy (advance (chunk->size), chunk->data, chunk->size);
+		}
 	}
+	else
+	{
+		if (lastChunk() == null)
+			setFirstChunk (other->firstChunk());
+		else
+			lastChunk()->next = other->firstChunk();
+
+		setLastChunk (other->lastChunk());
+		m_writtenSize += other->writtenSize();
 
-	m_marks.clear();
-	m_references.clear();
+		// What is left of our last chunk is skipped, so start small again to not waste more.
+		setChunkSize (min (max (other->writtenSize(), int (FirstChunkSize)), int (MaxChunkSize)));
+	}
 }
 
 // _________________________________________________________________________________________________
 //
-//	Adds a new mark to the current position with the given name
+//	Adds a new mark to the current position and returns it.
 //
-ByteMark* DataBuffer::addMark (const String& name)
+ByteMark DataBuffer::addMark()
 {
-	ByteMark* mark = new ByteMark;
-	mark->name = name;
-	mark->pos = writtenSize();
-	m_marks << mark;
+	MarkPositions.push_back ({null, 0});
+	ByteMark mark = MarkPositions.size() - 1;
+	adjustMark (mark);
 	return mark;
 }
 
 // _________________________________________________________________________________________________
 //
-//	Adds a new reference to the given mark at the current position. This function will write 4 
+//	Adds a new reference to the given mark at the current position. This function will write 4
 //	bytes to the buffer whose value will be determined at final output writing.
 //
-MarkReference* DataBuffer::addReference (ByteMark* mark)
+void DataBuffer::addReference (ByteMark mark)
 {
-	MarkReference* ref = new MarkReference;
-	ref->target = mark;
-	ref->pos = writtenSize();
-	m_references << ref;
+	checkSpace (4);
+	Relocations.push_back ({lastChunk(), lastChunk()->size, mark});
 
 	// Write a dummy placeholder for the reference
 	writeDWord (0xBEEFCAFE);
+}
 
-	return ref;
+// _________________________________________________________________________________________________
+//
+//	Adds a reference to the string of the given number at the current position. This writes 4
+//	bytes, which become the slot of the string in the string table once they are flushed.
+//
+void DataBuffer::addStringReference (int number)
+{
+	checkSpace (4);
+	StringRelocations.push_back ({lastChunk(), lastChunk()->size, number});
+	writeDWord (number);
 }
 
 // _________________________________________________________________________________________________
 //
 //	Moves the given mark to the current bytecode position.
 //
-void DataBuffer::adjustMark (ByteMark* mark)
+void DataBuffer::adjustMark (ByteMark mark)
+{
+	checkSpace (0);
+
+	if (MarkPositions[mark].chunk == null and size_t (mark) < NumCheckedMarks)
+		PendingMarks.push_back (mark);
+
+	MarkPositions[mark] = {lastChunk(), lastChunk()->size};
+}
+
+// _________________________________________________________________________________________________
+//
+//	Follows a chunk to where its bytes went, and returns the chunk that has them now. The offset
+//	is adjusted to match. Chains of moves are shortened on the way so they are only walked once.
+//
+static DataChunk* findPlacedChunk (DataChunk* chunk, int& offset)
+{
+	if (chunk->movedTo == null)
+		return chunk;
+
+	DataChunk* target = findPlacedChunk (chunk->movedTo, chunk->base);
+	chunk->movedTo = target;
+	offset += chunk->base;
+	return target;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Looks at whether the given mark is in the chunks being flushed, and if it is, adds it to the
+//	flushed bytecode. Returns whether the mark is still waiting to be flushed.
+//
+static bool placeMark (ByteMark mark, Bytecode& code)
 {
-	mark->pos = writtenSize();
+	const MarkPosition& position = MarkPositions[mark];
+
+	if (position.chunk == null)
+		return false;
+
+	int offset = position.offset;
+	DataChunk* chunk = findPlacedChunk (position.chunk, offset);
+
+	if (chunk->base == -1)
+		return true;
+
+	code.marks.push_back ({mark, chunk->base + offset, false});
+	return false;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Writes the contents of the buffer to the given writer and empties the buffer. The bytecode is
+//	optimized first if asked to, and the references in it are filled in. References to marks that
+//	are not written yet are patched into the output once their marks are flushed. References in
+//	chunks that are not part of this buffer are left alone.
+//
+void DataBuffer::flush (ObjectWriter& writer, int optimizationLevel)
+{
+	Bytecode code;
+	code.data.resize (writtenSize());
+	int base = 0;
+
+	for (DataChunk* chunk = firstChunk(); chunk != null; chunk = chunk->next)
+	{
+		chunk->base = base;
+		std::memcpy (code.data.data() + base, chunk->data, chunk->size);
+		base += chunk->size;
+	}
+
+	// Gather the marks and references in the flushed bytes.
+	std::vector<ByteMark> pending;
+
+	for (ByteMark mark : PendingMarks)
+	{
+		if (placeMark (mark, code))
+			pending.push_back (mark);
+	}
+
+	for (; NumCheckedMarks < MarkPositions.size(); ++NumCheckedMarks)
+	{
+		if (placeMark (NumCheckedMarks, code))
+			pending.push_back (NumCheckedMarks);
+	}
+
+	PendingMarks.swap (pending);
+	size_t numRelocations = 0;
+
+	for (const Relocation& ref : Relocations)
+	{
+		int offset = ref.offset;
+		DataChunk* chunk = findPlacedChunk (ref.chunk, offset);
+
+		if (chunk->base == -1)
+			Relocations[numRelocations++] = ref;
+		else
+			code.references.push_back ({chunk->base + offset, ref.mark});
+	}
+
+	Relocations.resize (numRelocations);
+	size_t numStringRelocations = 0;
+
+	for (const StringRelocation& ref : StringRelocations)
+	{
+		int offset = ref.offset;
+		DataChunk* chunk = findPlacedChunk (ref.chunk, offset);
+
+		if (chunk->base == -1)
+			StringRelocations[numStringRelocations++] = ref;
+		else
+			code.strings.push_back ({chunk->base + offset, ref.number});
+	}
+
+	StringRelocations.resize (numStringRelocations);
+
+	if (optimizationLevel > 0)
+	{
+		// The optimizer needs to know which marks the bytecode elsewhere jumps to.
+		std::unordered_set<ByteMark> referenced;
+
+		for (const Relocation& ref : Relocations)
+			referenced.insert (ref.mark);
+
+		for (const Fixup& fixup : Fixups)
+			referenced.insert (fixup.mark);
+
+		for (Bytecode::Mark& mark : code.marks)
+			mark.isReferencedElsewhere = (referenced.count (mark.mark) != 0);
+
+		code.numMarks = MarkPositions.size();
+		BytecodeOptimizer (code).optimize (optimizationLevel);
+
+		// The marks that the optimizer placed are flushed along with the rest.
+		MarkPositions.resize (code.numMarks);
+		NumCheckedMarks = MarkPositions.size();
+	}
+
+	// Now that the bytes are final, the marks have their places in the output and the references
+	// can be filled in. The strings that are still pushed get their slots.
+	base = writer.position();
+
+	for (const Bytecode::StringReference& ref : code.strings)
+		storeLittleEndian (code.data.data() + ref.position, uint32_t (placeString (ref.number)));
+
+	for (const Bytecode::Mark& mark : code.marks)
+		MarkPositions[mark.mark] = {null, base + mark.position};
+
+	for (const Bytecode::Reference& ref : code.references)
+	{
+		const MarkPosition& target = MarkPositions[ref.mark];
+
+		if (target.chunk == null)
+			storeLittleEndian (code.data.data() + ref.position, uint32_t (target.offset));
+		else
+			Fixups.push_back ({base + ref.position, ref.mark});
+	}
+
+	writer.write (code.data.data(), code.data.size());
+
+	// Patch the references written earlier whose marks were flushed just now.
+	size_t numFixups = 0;
+
+	for (const Fixup& fixup : Fixups)
+	{
+		const MarkPosition& target = MarkPositions[fixup.mark];
+
+		if (target.chunk == null)
+			writer.patch (fixup.position, uint32_t (target.offset));
+		else
+			Fixups[numFixups++] = fixup;
+	}
+
+	Fixups.resize (numFixups);
+
+	// Nothing refers to the written chunks any more, so the largest ones can be used again.
+	for (DataChunk* chunk = firstChunk(); chunk != null;)
+	{
+		DataChunk* next = chunk->next;
+
+		if (chunk->capacity == MaxChunkSize)
+		{
+			chunk->next = SpareChunks;
+			SpareChunks = chunk;
+		}
+
+		chunk = next;
+	}
+
+	release();
 }
 
 // _________________________________________________________________________________________________
 //
-//	Shifts the given mark by the amount of bytes
+//	Returns whether the given buffer holds the same bytes as this one. The marks and references in
+//	them are not compared.
 //
-void DataBuffer::offsetMark (ByteMark* mark, int bytes)
+bool DataBuffer::hasSameBytesAs (const DataBuffer& other) const
 {
-	mark->pos += bytes;
+	if (writtenSize() != other.writtenSize())
+		return false;
+
+	const DataChunk* chunk = firstChunk();
+	const DataChunk* otherChunk = other.firstChunk();
+	int offset = 0;
+	int otherOffset = 0;
+
+	for (int remaining = writtenSize(); remaining > 0;)
+	{
+		while (offset == chunk->size)
+		{
+			chunk = chunk->next;
+			offset = 0;
+		}
+
+		while (otherOffset == otherChunk->size)
+		{
+			otherChunk = otherChunk->next;
+			otherOffset = 0;
+		}
+
+		int length = min (min (chunk->size - offset, otherChunk->size - otherOffset), remaining);
+
+		if (std::memcmp (chunk->data + offset, otherChunk->data + otherOffset, length) != 0)
+			return false;
+
+		offset += length;
+		otherOffset += length;
+		remaining -= length;
+	}
+
+	return true;
 }
 
 // _________________________________________________________________________________________________
@@ -168,7 +476,7 @@ void DataBuffer::offsetMark (ByteMark* mark, int bytes)
 void DataBuffer::writeStringIndex (const String& a)
 {
 	writeHeader (DataHeader::PushStringIndex);
-	writeDWord (getStringTableIndex (a));
+	addStringReference (getStringTableIndex (a));
 }
 
 // _________________________________________________________________________________________________
@@ -186,41 +494,62 @@ void DataBuffer::writeHeader (DataHeader data)
 //
 void DataBuffer::dump()
 {
-	for (int i = 0; i < writtenSize(); ++i)
-		printf ("%d. [0x%X]\n", i, buffer()[i]);
+	int i = 0;
+
+	for (DataChunk* chunk = firstChunk(); chunk != null; chunk = chunk->next)
+	{
+		for (int j = 0; j < chunk->size; ++j)
+			printf ("%d. [0x%X]\n", i++, chunk->data[j]);
+	}
 }
 
 // _________________________________________________________________________________________________
 //
-// Ensures there's at least the given amount of bytes left in the buffer. Will resize if necessary,
-// no-op if not. On resize, 512 extra bytes are allocated to reduce the amount of resizes.
+//	Makes room for the buffer to hold at least the given amount of bytes in total, so that they can
+//	be written into one chunk.
 //
-void DataBuffer::checkSpace (int bytes)
+void DataBuffer::reserve (int size)
 {
-	int writesize = writtenSize();
-
-	if (writesize + bytes < allocatedSize())
-		return;
-
-	// We don't have enough space in the buffer to write
-	// the stuff - thus resize.
+	if (size > writtenSize())
+		checkSpace (size - writtenSize());
+}
 
-	// Remake the buffer with the new size. Have enough space
-	// for the stuff we're going to write, as well as a bit
-	// of leeway so we don't have to resize immediately again.
+// _________________________________________________________________________________________________
+//
+//	Starts a new chunk with room for at least the given amount of bytes. Each chunk is twice the
+//	size of the one before it, up to MaxChunkSize. Chunks of that size are taken from the flushed
+//	ones when there are any.
+//
+void DataBuffer::addChunk (int bytes)
+{
+	int capacity = max (chunkSize(), bytes);
+	DataChunk* chunk;
 
-	int oldsize = allocatedSize();
-	int newsize = oldsize + bytes + 512;
+	if (capacity == MaxChunkSize and SpareChunks != null)
+	{
+		chunk = SpareChunks;
+		SpareChunks = chunk->next;
+	}
+	else
+	{
+		chunk = static_cast<DataChunk*> (
+			Arena::Current()->allocate (sizeof (DataChunk) + capacity, alignof (DataChunk)));
+	}
 
-	char* buf = buffer();
-	setBuffer (new char[newsize]);
-	setAllocatedSize (newsize);
+	chunk->next = null;
+	chunk->movedTo = null;
+	chunk->data = reinterpret_cast<char*> (chunk + 1);
+	chunk->size = 0;
+	chunk->capacity = capacity;
+	chunk->base = -1;
 
-	// Now, copy the stuff back.
-	std::memcpy (m_buffer, buf, oldsize);
-	setPosition (buffer() + writesize);
+	if (lastChunk() == null)
+		setFirstChunk (chunk);
+	else
+		lastChunk()->next = chunk;
 
-	delete buf;
+	setLastChunk (chunk);
+	setChunkSize (min (chunkSize() * 2, MaxChunkSize));
 }
 
 // _________________________________________________________________________________________________
@@ -229,8 +558,7 @@ void DataBuffer::checkSpace (int bytes)
 //
 void DataBuffer::writeByte (int8_t data)
 {
-	checkSpace (1);
-	*m_position++ = data;
+	*advance (1) = data;
 }
 
 // _________________________________________________________________________________________________
@@ -239,10 +567,7 @@ void DataBuffer::writeByte (int8_t data)
 //
 void DataBuffer::writeWord (int16_t data)
 {
-	checkSpace (2);
-
-	for (int i = 0; i < 2; ++i)
-		*m_position++ = (data >> (i * 8)) & 0xFF;
+	storeLittleEndian (advance (2), uint16_t (data));
 }
 
 // _________________________________________________________________________________________________
@@ -251,10 +576,7 @@ void DataBuffer::writeWord (int16_t data)
 //
 void DataBuffer::writeDWord (int32_t data)
 {
-	checkSpace (4);
-
-	for (int i = 0; i < 4; ++i)
-		*m_position++ = (data >> (i * 8)) & 0xFF;
+	storeLittleEndian (advance (4), uint32_t (data));
 }
 
 // _________________________________________________________________________________________________
@@ -266,22 +588,5 @@ void DataBuffer::writeString (const String& a)
 {
 	checkSpace (a.length() + 4);
 	writeDWord (a.length());
-
-	for (char c : a)
-		writeByte (c);
-}
-
-// _________________________________________________________________________________________________
-//
-//	Tries to locate the mark by the given name. Returns null if not found.
-//
-ByteMark* DataBuffer::findMarkByName (const String& name)
-{
-	for (ByteMark* mark : marks())
-	{
-		if (mark->name == name)
-			return mark;
-	}
-
-	return null;
+	std::memcpy (advance (a.length()), a.c_str(), a.length());
 }
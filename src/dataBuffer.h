@@ -33,68 +33,141 @@
 #ifndef BOTC_DATABUFFER_H
 #define BOTC_DATABUFFER_H
 
+#include <memory>
 #include "main.h"
 #include "stringTable.h"
 
+class DataBuffer;
+class ObjectWriter;
+
+// _________________________________________________________________________________________________
+//
+//	Owns a data buffer. Buffers and their chunks belong to the compilation's arena, so letting go of
+//	one only empties it.
+//
+struct DataBufferReleaser
+{
+	void operator() (DataBuffer* buffer) const;
+};
+
+typedef std::unique_ptr<DataBuffer, DataBufferReleaser> DataBufferPtr;
+
+// _________________________________________________________________________________________________
+//
+//	A piece of the bytes of a data buffer. The bytes follow the chunk in the same allocation. The
+//	base is the offset of the chunk in the output and is only known once the chunk is flushed.
+//	A small chunk that was copied into another one is moved to it, and then the base is where in
+//	the other chunk its bytes went.
+//
+struct DataChunk
+{
+	DataChunk*	next;
+	DataChunk*	movedTo;
+	char*		data;
+	int			size;
+	int			capacity;
+	int			base;
+};
+
 // _________________________________________________________________________________________________
 //
-//	The DataBuffer class stores a section of bytecode. Buffers are allocated on
-//	the heap and written to using the @c write* functions. Buffers can be cut and
-//	pasted together with @c mergeAndDestroy, note that this function destroys the
-//	parameter buffer in the process
+//	The DataBuffer class stores a section of bytecode. Buffers are created with
+//	@c Create, which gives a DataBufferPtr that owns the buffer, and written to
+//	using the @c write* functions. Buffers can be cut and pasted together with
+//	@c mergeAndDestroy, which takes the ownership of the parameter buffer and
+//	releases it in the process
+//
+//	The bytes are kept in a list of chunks. Merging a large buffer into another
+//	links its chunks to the end of the list instead of copying them, so nesting
+//	buffers does not copy the bytes again at every level. Each write stays within
+//	one chunk.
 //
 //	A mark is a "pointer" to a particular position in the bytecode. The actual
 //	permanent position cannot be predicted in any way or form, thus these things
-//	are used to "bookmark" a position like that for future use.
+//	are used to "bookmark" a position like that for future use. Marks are numbers
+//	into a table of positions, each given as a chunk and an offset into it.
 //
 //	A reference acts as a pointer to a mark. The reference is four bytes in the
 //	bytecode which will be replaced with its mark's position when the bytecode
-//	is written to the output file.
+//	is written to the output file. References are kept in one table for all
+//	buffers, so neither marks nor references need to be moved along when buffers
+//	are merged; a copied chunk just records where it was moved.
+//
+//	A buffer is written out with @c flush, which can be done any number of times
+//	as the bytecode comes in. A reference to a mark that is not written yet is
+//	filled in once the mark is. Flushing is also where the bytecode optimizer
+//	runs, as that is when a piece of bytecode is complete.
 //
 //	This mark/reference system is used to know bytecode offset values when
 //	compiling, even though actual final positions cannot be known.
 //
 class DataBuffer
 {
-	PROPERTY (private, char*,					buffer,			setBuffer,			STOCK_WRITE)
-	PROPERTY (private, int,						allocatedSize,	setAllocatedSize,	STOCK_WRITE)
-	PROPERTY (private, char*,					position,		setPosition,		STOCK_WRITE)
-	PROPERTY (private, List<ByteMark*>,			marks,			setMarks,			STOCK_WRITE)
-	PROPERTY (private, List<MarkReference*>,	references,		setReferences,		STOCK_WRITE)
+	DELETE_COPY (DataBuffer)
+
+	PROPERTY (private, DataChunk*,					firstChunk,		setFirstChunk,		STOCK_WRITE)
+	PROPERTY (private, DataChunk*,					lastChunk,		setLastChunk,		STOCK_WRITE)
+	PROPERTY (private, int,							writtenSize,	setWrittenSize,		STOCK_WRITE)
+	PROPERTY (private, int,							chunkSize,		setChunkSize,		STOCK_WRITE)
 
 public:
-	DataBuffer (int size = 128);
-	~DataBuffer();
-
-	ByteMark*		addMark (const String& name);
-	MarkReference*	addReference (ByteMark* mark);
-	void			adjustMark (ByteMark* mark);
-	void			checkSpace (int bytes);
-	DataBuffer*		clone();
+	// Expression buffers are small, so the first chunk is too. Later chunks double in size up to
+	// the largest size.
+	static constexpr int FirstChunkSize = 64;
+	static constexpr int MaxChunkSize = 8192;
+
+	// Merged buffers up to this size are copied rather than linked.
+	static constexpr int CopyLimit = 1024;
+
+	DataBuffer (int size = FirstChunkSize);
+
+	ByteMark		addMark();
+	void			addReference (ByteMark mark);
+	void			addStringReference (int number);
+	void			adjustMark (ByteMark mark);
+	inline void		checkSpace (int bytes);
 	void			dump();
-	ByteMark*		findMarkByName (const String& name);
-	void			mergeAndDestroy (DataBuffer* other);
-	void			offsetMark (ByteMark* mark, int position);
-	void			transferMarksTo (DataBuffer* other);
+	void			flush (ObjectWriter& writer, int optimizationLevel = 0);
+	bool			hasSameBytesAs (const DataBuffer& other) const;
+	void			mergeAndDestroy (DataBufferPtr other);
+	void			release();
+	void			reserve (int size);
 	void			writeStringIndex (const String& a);
 	void			writeString (const String& a);
 	void			writeByte (int8_t data);
 	void			writeWord (int16_t data);
 	void			writeDWord (int32_t data);
 	void			writeHeader (DataHeader data);
-	inline int		writtenSize() const;
+
+	static DataBufferPtr	Create (int size = FirstChunkSize);
+	static void				ClearTables();
 
 private:
-	void			copyBuffer (const DataBuffer* buf);
+	void			addChunk (int bytes);
+	inline char*	advance (int bytes);
 };
 
 // _________________________________________________________________________________________________
 //
-//	Returns the amount of bytes written into the buffer.
+//	Ensures there's at least the given amount of bytes left in the last chunk.
+//
+inline void DataBuffer::checkSpace (int bytes)
+{
+	if (lastChunk() == null or lastChunk()->size + bytes > lastChunk()->capacity)
+		addChunk (bytes);
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns where to write the given amount of bytes and counts them as written.
 //
-inline int DataBuffer::writtenSize() const
+inline char* DataBuffer::advance (int bytes)
 {
-	return position() - buffer();
+	checkSpace (bytes);
+	char* position = m_lastChunk->data + m_lastChunk->size;
+	m_lastChunk->size += bytes;
+	m_writtenSize += bytes;
+	return position;
 }
 
 #endif // BOTC_DATABUFFER_H
@@ -37,14 +37,44 @@
 #include "main.h"
 #include "stringClass.h"
 #include "events.h"
+#include "registry.h"
 #include "lexer.h"
 
 static List<EventDefinition*> Events;
+static Registry<EventDefinition> EventRegistry;
 
 // _________________________________________________________________________________________________
 //
 void addEvent (EventDefinition* e)
 {
+	// Defining the very same event again is let through, as with commands. A script's own
+	// definition of an event is used in place of a loaded one of the same number or name.
+	EventDefinition* it = EventRegistry.findByNumber (e->number);
+
+	if (it != null and it->name == e->name)
+		return;
+
+	EventDefinition* samename = EventRegistry.find (e->name);
+
+	if ((it != null and it->ispreloaded) or (samename != null and samename->ispreloaded))
+	{
+		if (it != null and it->ispreloaded)
+			Events.removeOne (it);
+
+		if (samename != null and samename->ispreloaded)
+			Events.removeOne (samename);
+
+		EventRegistry.clear();
+
+		for (EventDefinition* other : Events)
+		{
+			EventRegistry.insertNumber (other, other->number);
+			EventRegistry.insert (other, other->name);
+		}
+	}
+
+	EventRegistry.insertNumber (e, e->number);
+	EventRegistry.insert (e, e->name);
 	Events << e;
 }
 
@@ -61,13 +91,17 @@ EventDefinition* findEventByIndex (int idx)
 //
 // Finds an event definition by name
 //
-EventDefinition* findEventByName (String a)
+EventDefinition* findEventByName (const String& a)
 {
-	for (EventDefinition* e : Events)
-	{
-		if (a.toUppercase() == e->name.toUppercase())
-			return e;
-	}
+	return EventRegistry.find (a);
+}
 
-	return null;
+// _________________________________________________________________________________________________
+//
+// Forgets all event definitions. They belong to the arena, which frees them.
+//
+void clearEvents()
+{
+	Events.clear();
+	EventRegistry.clear();
 }
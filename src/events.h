@@ -39,10 +39,12 @@ struct EventDefinition
 {
 	String name;
 	int number;
+	bool ispreloaded;
 };
 
 void addEvent (EventDefinition* e);
 EventDefinition* findEventByIndex (int idx);
-EventDefinition* findEventByName (String a);
+EventDefinition* findEventByName (const String& a);
+void clearEvents();
 
 #endif // BOTC_EVENTS_H
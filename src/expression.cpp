@@ -31,7 +31,9 @@
 */
 
 #include <climits>
+#include <cstring>
 #include "expression.h"
+#include "arena.h"
 #include "dataBuffer.h"
 #include "lexer.h"
 
@@ -70,67 +72,168 @@ static const OperatorInfo g_Operators[] =
 
 // _________________________________________________________________________________________________
 //
-Expression::Expression (BotscriptParser* parser, Lexer* lx, DataType reqtype) :
+// The operators that each token stands for, looked up by token. A token may
+// begin an operand as a unary operator, follow one as a binary operator, or
+// both, as the minus does.
+//
+struct OperatorTable
+{
+	signed char unary[int (Token::NumValues)];
+	signed char binary[int (Token::NumValues)];
+
+	OperatorTable()
+	{
+		memset (unary, -1, sizeof unary);
+		memset (binary, -1, sizeof binary);
+
+		for (int i = 0; i < countof (g_Operators); ++i)
+		{
+			if (g_Operators[i].numoperands == 1)
+				unary[int (g_Operators[i].token)] = i;
+			else
+				binary[int (g_Operators[i].token)] = i;
+		}
+	}
+};
+
+static const OperatorTable g_OperatorTable;
+
+// _________________________________________________________________________________________________
+//
+Expression::Expression (BotscriptParser* parser, Lexer* lx, DataType reqtype,
+	bool shortcircuit) :
 	m_parser (parser),
 	m_lexer (lx),
-	m_type (reqtype)
+	m_result (null),
+	m_type (reqtype),
+	m_startPosition (lx->position()),
+	m_isShortCircuiting (shortcircuit)
+{
+	m_result = parseBinary (INT_MAX);
+}
+
+// _________________________________________________________________________________________________
+//
+// Parses operands joined by binary operators of at most the given priority.
+// Operators of the same priority are applied from left to right, so the right
+// operand of one only takes in operators that bind tighter.
+//
+ExpressionValue* Expression::parseBinary (int maxpriority)
 {
-	ExpressionSymbol* sym;
+	ExpressionValue* left = parseUnary();
+	Lexer::TokenInfo next;
 
-	while ((sym = parseSymbol()) != null)
-		m_symbols << sym;
+	while (m_lexer->peekNext (&next))
+	{
+		int id = g_OperatorTable.binary[int (next.type)];
 
-	// If we were unable to get any expression symbols, something's wonky with
-	// the script. Report an error. mBadTokenText is set to the token that
-	// ParseSymbol ends at when it returns false.
-	if (m_symbols.isEmpty())
-		error ("unknown identifier '%1'", m_badTokenText);
+		if (id == -1 or g_Operators[id].priority > maxpriority)
+			break;
+
+		m_lexer->skip();
 
-	adjustOperators();
-	verify();
-	evaluate();
+		if (m_type == TYPE_String)
+			error ("Cannot perform operations on strings");
+
+		ExpressionValue* values[3] = { left, null, null };
+
+		if (id == OPER_Ternary)
+		{
+			// The true case of ?: is a single operand. The false case takes in every operator that
+			// binds tighter than ?: does, and a ?: that follows has all of this as its condition.
+			values[1] = parseOperand();
+
+			if (m_lexer->next (Token::Colon) == false)
+				error ("ill-formed expression");
+		}
+
+		values[id == OPER_Ternary ? 2 : 1] = parseBinary (g_Operators[id].priority - 1);
+		left = evaluateOperator (ExpressionOperatorType (id), values);
+	}
+
+	return left;
 }
 
 // _________________________________________________________________________________________________
 //
-Expression::~Expression()
+// Parses an operand with any unary operators in front of it.
+//
+ExpressionValue* Expression::parseUnary()
 {
-	for (ExpressionSymbol* sym : m_symbols)
-		delete sym;
+	Lexer::TokenInfo next;
+	int id = m_lexer->peekNext (&next) ? g_OperatorTable.unary[int (next.type)] : -1;
+
+	if (id == -1)
+		return parseOperand();
+
+	m_lexer->skip();
+
+	if (m_type == TYPE_String)
+		error ("Cannot perform operations on strings");
+
+	ExpressionValue* values[1] = { parseUnary() };
+	return evaluateOperator (ExpressionOperatorType (id), values);
 }
 
 // _________________________________________________________________________________________________
 //
-// Try to parse an expression symbol (i.e. an operator or operand or a colon)
-// from the lexer.
+// Parses an operand, which must be there.
 //
-ExpressionSymbol* Expression::parseSymbol()
+ExpressionValue* Expression::parseOperand()
 {
-	int pos = m_lexer->position();
-	ExpressionValue* op = null;
+	ExpressionValue* value = parsePrimary();
+
+	if (value != null)
+		return value;
 
-	if (m_lexer->next (Token::Colon))
-		return new ExpressionColon;
+	// If nothing at all could be read, the expression is just something the
+	// script should not have here.
+	Lexer::TokenInfo next;
 
-	// Check for operator
-	for (const OperatorInfo& op : g_Operators)
+	if (m_lexer->position() == m_startPosition
+		and (m_lexer->peekNext (&next) == false
+			or (g_OperatorTable.binary[int (next.type)] == -1
+				and g_OperatorTable.unary[int (next.type)] == -1
+				and next.type != Token::Colon)))
 	{
-		if (m_lexer->next (op.token))
-			return new ExpressionOperator ((ExpressionOperatorType) (&op - &g_Operators[0]));
+		error ("unknown identifier '%1'", m_badTokenText);
 	}
 
+	error ("ill-formed expression");
+	return null;
+}
+
+// _________________________________________________________________________________________________
+//
+// Try to parse an operand (a value, variable, function call or sub-expression)
+// from the lexer. Returns null if there is none.
+//
+ExpressionValue* Expression::parsePrimary()
+{
+	int pos = m_lexer->position();
+	ExpressionValue* op = null;
+
 	// Check sub-expression
 	if (m_lexer->next (Token::ParenStart))
 	{
-		Expression expr (m_parser, m_lexer, m_type);
+		Expression expr (m_parser, m_lexer, m_type, m_isShortCircuiting);
 		m_lexer->mustGetNext (Token::ParenEnd);
-		return expr.getResult()->clone();
+
+		// Take the result over from the sub-expression.
+		op = expr.m_result;
+		expr.m_result = null;
+		return op;
 	}
 
-	op = new ExpressionValue (m_type);
+	op = create<ExpressionValue> (m_type);
 
 	// Check function
-	if (CommandInfo* comm = findCommandByName (m_lexer->peekNextString()))
+	Lexer::TokenInfo next;
+	CommandInfo* comm = m_lexer->peekNext (&next)
+		? findCommandByName (next.textData, next.textLength)
+		: null;
+
+	if (comm != null)
 	{
 		m_lexer->skip();
 
@@ -138,6 +241,7 @@ ExpressionSymbol* Expression::parseSymbol()
 			error ("%1 returns an incompatible data type", comm->name);
 
 		op->setBuffer (m_parser->parseCommand (comm));
+		op->setPure (false);
 		return op;
 	}
 
@@ -161,10 +265,13 @@ ExpressionSymbol* Expression::parseSymbol()
 			m_lexer->mustGetNext (Token::BracketStart);
 			Expression expr (m_parser, m_lexer, TYPE_Int);
 			expr.getResult()->convertToBuffer();
-			DataBuffer* buf = expr.getResult()->buffer()->clone();
+			DataBufferPtr buf = expr.getResult()->takeBuffer();
 			buf->writeHeader (DataHeader::PushGlobalArray);
 			buf->writeDWord (var->index);
-			op->setBuffer (buf);
+			op->setBuffer (std::move (buf));
+
+			// The index may be out of the bounds of the array.
+			op->setPure (false);
 			m_lexer->mustGetNext (Token::BracketEnd);
 		}
 		elif (var->writelevel == WRITE_Constexpr)
@@ -173,7 +280,7 @@ ExpressionSymbol* Expression::parseSymbol()
 		}
 		else
 		{
-			DataBuffer* buf = new DataBuffer (8);
+			DataBufferPtr buf = DataBuffer::Create (8);
 
 			if (var->isGlobal())
 				buf->writeHeader (DataHeader::PushGlobalVar);
@@ -181,7 +288,7 @@ ExpressionSymbol* Expression::parseSymbol()
 				buf->writeHeader (DataHeader::PushLocalVar);
 
 			buf->writeDWord (var->index);
-			op->setBuffer (buf);
+			op->setBuffer (std::move (buf));
 		}
 
 		return op;
@@ -227,262 +334,130 @@ ExpressionSymbol* Expression::parseSymbol()
 		}
 	}
 
-	m_badTokenText = m_lexer->token()->text;
+	m_badTokenText = m_lexer->tokenText();
 	m_lexer->setPosition (pos);
-	delete op;
 	return null;
 }
 
 // _________________________________________________________________________________________________
 //
-// The symbol parsing process only does token-based checking for operators.
-// Thus ALL minus operators are actually unary minuses simply because both
-// have Token::Minus as their token and the unary minus is prior to the binary minus
-// in the operator table. Now that we have all symbols present, we can
-// correct cases like this.
-//
-void Expression::adjustOperators()
-{
-	for (auto it = m_symbols.begin() + 1; it != m_symbols.end(); ++it)
-	{
-		if ((*it)->type() != EXPRSYM_Operator)
-			continue;
-
-		ExpressionOperator* op = static_cast<ExpressionOperator*> (*it);
-
-		// Unary minus with a value as the previous symbol cannot really be
-		// unary; replace with binary minus.
-		if (op->id() == OPER_UnaryMinus and (*(it - 1))->type() == EXPRSYM_Value)
-			op->setID (OPER_Subtraction);
-	}
-}
-
-// _________________________________________________________________________________________________
-//
-// Verifies a single value. Helper function for Expression::verify.
-//
-void Expression::tryVerifyValue (List<bool>& verified, SymbolList::Iterator it)
-{
-	// If it's an unary operator we skip to its value. The actual operator will
-	// be verified separately.
-	if ((*it)->type() == EXPRSYM_Operator and
-			g_Operators[static_cast<ExpressionOperator*> (*it)->id()].numoperands == 1)
-	{
-		++it;
-	}
-
-	int i = it - m_symbols.begin();
-
-	// Ensure it's an actual value
-	if ((*it)->type() != EXPRSYM_Value)
-		error ("malformed expression (symbol #%1 is not a value)", i);
-
-	verified[i] = true;
-}
-
-// _________________________________________________________________________________________________
-//
-// Ensures the expression is valid and well-formed and not OMGWTFBBQ. Throws an
-// error if this is not the case.
+// Process the given operator and values into a new value.
 //
-void Expression::verify()
+ExpressionValue* Expression::evaluateOperator (ExpressionOperatorType op,
+											   ExpressionValue* const* values)
 {
-	if (m_symbols.size() == 1)
-	{
-		if (m_symbols[0]->type() != EXPRSYM_Value)
-			error ("bad expression");
-
-		return;
-	}
-
-	if (m_type == TYPE_String)
-		error ("Cannot perform operations on strings");
-
-	List<bool> verified (m_symbols.size());
-
-	for (bool& a : verified)
-		a = false;
-
-	const auto last = m_symbols.end() - 1;
-	const auto first = m_symbols.begin();
+	const OperatorInfo* info = &g_Operators[op];
+	bool isconstexpr = true;
 
-	for (auto it = m_symbols.begin(); it != m_symbols.end(); ++it)
+	// See whether the values are constexpr
+	for (int i = 0; i < info->numoperands; ++i)
 	{
-		int i = (it - first);
-
-		if ((*it)->type() != EXPRSYM_Operator)
-			continue;
-
-		ExpressionOperator* op = static_cast<ExpressionOperator*> (*it);
-		int numoperands = g_Operators[op->id()].numoperands;
-
-		switch (numoperands)
+		if (not values[i]->isConstexpr())
 		{
-			case 1:
-			{
-				// Ensure that:
-				// -	unary operator is not the last symbol
-				// -	unary operator is succeeded by a value symbol
-				// -	neither symbol overlaps with something already verified
-				tryVerifyValue (verified, it + 1);
-
-				if (it == last or verified[i] == true)
-					error ("ill-formed expression");
-
-				verified[i] = true;
-				break;
-			}
-
-			case 2:
-			{
-				// Ensure that:
-				// -	binary operator is not the first or last symbol
-				// -	is preceded and succeeded by values
-				// -	none of the three tokens are already verified
-				//
-				// Basically similar logic as above.
-				if (it == first or it == last or verified[i] == true)
-					error ("ill-formed expression");
-
-				tryVerifyValue (verified, it + 1);
-				tryVerifyValue (verified, it - 1);
-				verified[i] = true;
-				break;
-			}
-
-			case 3:
-			{
-				// Ternary operator case. This goes a bit nuts.
-				// This time we have the following:
-				//
-				// (VALUE) ? (VALUE) : (VALUE)
-				//         ^
-				// --------/ we are here
-				//
-				// Check that the:
-				// -	questionmark operator is not misplaced (first or last)
-				// -	the value behind the operator (-1) is valid
-				// -	the value after the operator (+1) is valid
-				// -	the value after the colon (+3) is valid
-				// -	none of the five tokens are verified
-				//
-				tryVerifyValue (verified, it - 1);
-				tryVerifyValue (verified, it + 1);
-				tryVerifyValue (verified, it + 3);
-
-				if (it == first
-					or it >= m_symbols.end() - 3
-					or verified[i] == true
-					or verified[i + 2] == true
-					or (*(it + 2))->type() != EXPRSYM_Colon)
-				{
-					error ("ill-formed expression");
-				}
-
-				verified[i] = true;
-				verified[i + 2] = true;
-				break;
-			}
-
-			default:
-				error ("WTF operator with %1 operands", numoperands);
+			isconstexpr = false;
+			break;
 		}
 	}
 
-	for (int i = 0; i < m_symbols.size(); ++i)
-	{
-		if (verified[i] == false)
-			error ("malformed expression: expr symbol #%1 is was left unverified", i);
-	}
-}
-
+	int32_t addend = 0;
 
-// _________________________________________________________________________________________________
-//
-// Which operator to evaluate?
-//
-Expression::SymbolList::Iterator Expression::findPrioritizedOperator()
-{
-	SymbolList::Iterator	best = m_symbols.end();
-	int						bestpriority = INT_MAX;
-
-	for (SymbolList::Iterator it = m_symbols.begin(); it != m_symbols.end(); ++it)
+	if (not isconstexpr and m_parser->optimizationLevel() > 0)
 	{
-		if ((*it)->type() != EXPRSYM_Operator)
-			continue;
-
-		ExpressionOperator* op = static_cast<ExpressionOperator*> (*it);
-		const OperatorInfo* info = &g_Operators[op->id()];
+		ExpressionValue* simplified = simplifyOperator (op, values);
 
-		if (info->priority < bestpriority)
-		{
-			best = it;
-			bestpriority = info->priority;
-		}
-	}
+		if (simplified != null)
+			return simplified;
 
-	return best;
-}
-
-// _________________________________________________________________________________________________
-//
-// Process the given operator and values into a new value.
-//
-ExpressionValue* Expression::evaluateOperator (const ExpressionOperator* op,
-											   const List<ExpressionValue*>& values)
-{
-	const OperatorInfo* info = &g_Operators[op->id()];
-	bool isconstexpr = true;
-	ASSERT_EQ (values.size(), info->numoperands)
+		// Constants that are added to the operands of a sum or a difference
+		// are added to the result instead.
+		if (op == OPER_UnaryMinus)
+			addend = int32_t (0u - uint32_t (values[0]->addend()));
+		elif (op == OPER_Addition)
+			addend = int32_t (uint32_t (values[0]->addend()) + uint32_t (values[1]->addend()));
+		elif (op == OPER_Subtraction)
+			addend = int32_t (uint32_t (values[0]->addend()) - uint32_t (values[1]->addend()));
 
-	// See whether the values are constexpr
-	for (ExpressionValue* val : values)
-	{
-		if (not val->isConstexpr())
+		if (addend != 0 or op == OPER_Addition or op == OPER_Subtraction)
 		{
-			isconstexpr = false;
-			break;
+			for (int i = 0; i < info->numoperands; ++i)
+				values[i]->setAddend (0);
 		}
 	}
 
 	// If not all of the values are constexpr, none of them shall be.
 	if (not isconstexpr)
 	{
-		for (ExpressionValue* val : values)
-			val->convertToBuffer();
+		for (int i = 0; i < info->numoperands; ++i)
+			values[i]->convertToBuffer();
 	}
 
-	ExpressionValue* newval = new ExpressionValue (m_type);
+	ExpressionValue* newval = create<ExpressionValue> (m_type);
+	newval->setAddend (addend);
+
+	bool isshortcircuit = m_isShortCircuiting
+		and (op == OPER_LogicalAnd or op == OPER_LogicalOr);
+
+	// Division can fail, and the ternary operator and short-circuiting logical
+	// operators jump, so that their bytecode cannot be compared with that of
+	// another value.
+	bool ispure = (op != OPER_Division and op != OPER_Modulus and op != OPER_Ternary
+		and not isshortcircuit);
+
+	for (int i = 0; i < info->numoperands; ++i)
+		ispure = ispure and values[i]->isPure();
+
+	newval->setPure (ispure);
 
 	if (isconstexpr == false)
 	{
 		// This is not a constant expression so we'll have to use databuffers
 		// to convey the expression to bytecode. Actual value cannot be evaluated
 		// until Zandronum processes it at run-time.
-		newval->setBuffer (new DataBuffer);
+		newval->setBuffer (DataBuffer::Create());
 
-		if (op->id() == OPER_Ternary)
+		if (op == OPER_Ternary)
 		{
 			// There isn't a dataheader for ternary operator. Instead, we use DataHeader::IfNotGoto
 			// to create an "if-block" inside an expression. Behold, big block of writing madness!
 			DataBuffer* buf = newval->buffer();
-			DataBuffer* b0 = values[0]->buffer();
-			DataBuffer* b1 = values[1]->buffer();
-			DataBuffer* b2 = values[2]->buffer();
-			ByteMark* mark1 = buf->addMark (""); // start of "else" case
-			ByteMark* mark2 = buf->addMark (""); // end of expression
-			buf->mergeAndDestroy (b0);
+			DataBufferPtr b0 = values[0]->takeBuffer();
+			DataBufferPtr b1 = values[1]->takeBuffer();
+			DataBufferPtr b2 = values[2]->takeBuffer();
+			ByteMark mark1 = buf->addMark(); // start of "else" case
+			ByteMark mark2 = buf->addMark(); // end of expression
+			buf->mergeAndDestroy (std::move (b0));
 			buf->writeHeader (DataHeader::IfNotGoto); // if the first operand (condition)
 			buf->addReference (mark1); // didn't eval true, jump into mark1
-			buf->mergeAndDestroy (b1); // otherwise, perform second operand (true case)
+			buf->mergeAndDestroy (std::move (b1)); // otherwise, perform second operand (true case)
 			buf->writeHeader (DataHeader::Goto); // afterwards, jump to the end, which is
 			buf->addReference (mark2); // marked by mark2.
 			buf->adjustMark (mark1); // move mark1 at the end of the true case
-			buf->mergeAndDestroy (b2); // perform third operand (false case)
+			buf->mergeAndDestroy (std::move (b2)); // perform third operand (false case)
 			buf->adjustMark (mark2); // move the ending mark2 here
-
-			for (int i = 0; i < 3; ++i)
-				values[i]->setBuffer (null);
+		}
+		elif (isshortcircuit)
+		{
+			// Like the ternary operator, but the left operand decides the result
+			// when it is false for && or true for ||. The right operand is made
+			// into 0 or 1 like the result of DataHeader::AndLogical would be.
+			DataBuffer* buf = newval->buffer();
+			DataBufferPtr b0 = values[0]->takeBuffer();
+			DataBufferPtr b1 = values[1]->takeBuffer();
+			bool isand = (op == OPER_LogicalAnd);
+			ByteMark mark1 = buf->addMark(); // the left operand decided
+			ByteMark mark2 = buf->addMark(); // end of expression
+			buf->mergeAndDestroy (std::move (b0));
+			buf->writeHeader (isand ? DataHeader::IfNotGoto : DataHeader::IfGoto);
+			buf->addReference (mark1);
+			buf->mergeAndDestroy (std::move (b1));
+			buf->writeHeader (DataHeader::NegateLogical);
+			buf->writeHeader (DataHeader::NegateLogical);
+			buf->writeHeader (DataHeader::Goto);
+			buf->addReference (mark2);
+			buf->adjustMark (mark1);
+			buf->writeHeader (DataHeader::PushNumber);
+			buf->writeDWord (isand ? 0 : 1);
+			buf->adjustMark (mark2);
 		}
 		else
 		{
@@ -490,14 +465,8 @@ ExpressionValue* Expression::evaluateOperator (const ExpressionOperator* op,
 
 			// Generic case: write all arguments and apply the operator's
 			// data header.
-			for (ExpressionValue* val : values)
-			{
-				newval->buffer()->mergeAndDestroy (val->buffer());
-
-				// Null the pointer out so that the value's destructor will not
-				// attempt to double-free it.
-				val->setBuffer (null);
-			}
+			for (int i = 0; i < info->numoperands; ++i)
+				newval->buffer()->mergeAndDestroy (values[i]->takeBuffer());
 
 			newval->buffer()->writeHeader (info->header);
 		}
@@ -506,13 +475,13 @@ ExpressionValue* Expression::evaluateOperator (const ExpressionOperator* op,
 	{
 		// We have a constant expression. We know all the values involved and
 		// can thus compute the result of this expression on compile-time.
-		List<int> nums;
+		int nums[3];
 		int a = 0;
 
-		for (ExpressionValue* val : values)
-			nums << val->value();
+		for (int i = 0; i < info->numoperands; ++i)
+			nums[i] = values[i]->value();
 
-		switch (op->id())
+		switch (op)
 		{
 			case OPER_Addition:				a = nums[0] + nums[1];					break;
 			case OPER_Subtraction:			a = nums[0] - nums[1];					break;
@@ -523,8 +492,8 @@ ExpressionValue* Expression::evaluateOperator (const ExpressionOperator* op,
 			case OPER_RightShift:			a = nums[0] >> nums[1];					break;
 			case OPER_CompareLesser:		a = (nums[0] < nums[1]) ? 1 : 0;		break;
 			case OPER_CompareGreater:		a = (nums[0] > nums[1]) ? 1 : 0;		break;
-			case OPER_CompareAtLeast:		a = (nums[0] <= nums[1]) ? 1 : 0;		break;
-			case OPER_CompareAtMost:		a = (nums[0] >= nums[1]) ? 1 : 0;		break;
+			case OPER_CompareAtLeast:		a = (nums[0] >= nums[1]) ? 1 : 0;		break;
+			case OPER_CompareAtMost:		a = (nums[0] <= nums[1]) ? 1 : 0;		break;
 			case OPER_CompareEquals:		a = (nums[0] == nums[1]) ? 1 : 0;		break;
 			case OPER_CompareNotEquals:		a = (nums[0] != nums[1]) ? 1 : 0;		break;
 			case OPER_BitwiseAnd:			a = nums[0] & nums[1];					break;
@@ -556,120 +525,167 @@ ExpressionValue* Expression::evaluateOperator (const ExpressionOperator* op,
 		newval->setValue (a);
 	}
 
-	// The new value has been generated. We don't need the old stuff anymore.
-	for (ExpressionValue* val : values)
-		delete val;
-
-	delete op;
 	return newval;
 }
 
 // _________________________________________________________________________________________________
 //
-ExpressionValue* Expression::evaluate()
+// Simplifies an operator that has a constant for an operand, or the same value
+// for both of its operands, without writing it. Values that are not pure are
+// never left out. Returns the result, or null if nothing could be done.
+//
+ExpressionValue* Expression::simplifyOperator (ExpressionOperatorType op,
+											   ExpressionValue* const* values)
 {
-	SymbolList::Iterator it;
+	if (g_Operators[op].numoperands != 2)
+		return null;
+
+	ExpressionValue* left = values[0];
+	ExpressionValue* right = values[1];
+
+	// x - x is zero, apart from the constants added to either side.
+	if (op == OPER_Subtraction
+		and not left->isConstexpr()
+		and not right->isConstexpr()
+		and left->isPure()
+		and right->isPure()
+		and left->buffer()->hasSameBytesAs (*right->buffer()))
+	{
+		ExpressionValue* newval = create<ExpressionValue> (m_type);
+		newval->setValue (int32_t (uint32_t (left->addend()) - uint32_t (right->addend())));
+		return newval;
+	}
 
-	while ((it = findPrioritizedOperator()) != m_symbols.end())
+	// The rest need one operand to be a constant.
+	if (left->isConstexpr() == right->isConstexpr())
+		return null;
+
+	ExpressionValue* constant = left->isConstexpr() ? left : right;
+	ExpressionValue* other = left->isConstexpr() ? right : left;
+	bool isright = (constant == right);
+	int32_t c = constant->value();
+
+	switch (op)
 	{
-		int i = it - m_symbols.begin();
-		List<SymbolList::Iterator> operands;
-		ExpressionOperator* op = static_cast<ExpressionOperator*> (*it);
-		const OperatorInfo* info = &g_Operators[op->id()];
+		case OPER_Addition:
+			other->setAddend (int32_t (uint32_t (other->addend()) + uint32_t (c)));
+			return other;
 
-		// Boundaries of area to replace
-		int lower = 0;
-		int upper = 0;
+		case OPER_Subtraction:
+			if (isright)
+			{
+				other->setAddend (int32_t (uint32_t (other->addend()) - uint32_t (c)));
+				return other;
+			}
+			break;
 
-		switch (info->numoperands)
-		{
-			case 1:
-				lower = i;
-				upper = i + 1;
-				operands << it + 1;
-				break;
+		case OPER_Multiplication:
+			if (c == 1)
+				return other;
 
-			case 2:
-				lower = i - 1;
-				upper = i + 1;
-				operands << it - 1
-				         << it + 1;
-				break;
+			if (c == 0 and other->isPure())
+				return constant;
+			break;
 
-			case 3:
-				lower = i - 1;
-				upper = i + 3;
-				operands << it - 1
-				         << it + 1
-				         << it + 3;
-				break;
+		case OPER_Division:
+			if (isright and c == 1)
+				return other;
+			break;
 
-			default:
-				error ("WTF bad expression with %1 operands", info->numoperands);
-		}
+		case OPER_LeftShift:
+		case OPER_RightShift:
+			if (isright and c == 0)
+				return other;
+			break;
+
+		case OPER_BitwiseOr:
+			if (c == 0)
+				return other;
+
+			if (c == -1 and other->isPure())
+				return constant;
+			break;
+
+		case OPER_BitwiseXOr:
+			if (c == 0)
+				return other;
+			break;
 
-		List<ExpressionValue*> values;
+		case OPER_BitwiseAnd:
+			if (c == -1)
+				return other;
 
-		for (auto it : operands)
-			values << static_cast<ExpressionValue*> (*it);
+			if (c == 0 and other->isPure())
+				return constant;
+			break;
 
-		// Note: @op and all of @values are invalid after this call.
-		ExpressionValue* newvalue = evaluateOperator (op, values);
+		case OPER_LogicalAnd:
+			if (c == 0 and other->isPure())
+				return constant;
+			break;
 
-		for (int i = upper; i >= lower; --i)
-			m_symbols.removeAt (i);
+		case OPER_LogicalOr:
+			if (c != 0 and other->isPure())
+			{
+				constant->setValue (1);
+				return constant;
+			}
+			break;
 
-		m_symbols.insert (lower, newvalue);
+		default:
+			break;
 	}
 
-	ASSERT_EQ (m_symbols.size(), 1)
-	ASSERT_EQ (m_symbols.first()->type(), EXPRSYM_Value)
-	ExpressionValue* val = static_cast<ExpressionValue*> (m_symbols.first());
-	return val;
+	return null;
 }
 
 // _________________________________________________________________________________________________
 //
 ExpressionValue* Expression::getResult()
 {
-	return static_cast<ExpressionValue*> (m_symbols.first());
+	return m_result;
 }
 
 // _________________________________________________________________________________________________
 //
 String Expression::getTokenString()
 {
-	return m_lexer->token()->text;
+	return m_lexer->tokenText();
 }
 
-// _________________________________________________________________________________________________
-//
-ExpressionOperator::ExpressionOperator (ExpressionOperatorType id) :
-	ExpressionSymbol (EXPRSYM_Operator),
-	m_id (id) {}
-
 // _________________________________________________________________________________________________
 //
 ExpressionValue::ExpressionValue (DataType valuetype) :
-	ExpressionSymbol (EXPRSYM_Value),
-	m_buffer (null),
-	m_valueType (valuetype) {}
-
-// _________________________________________________________________________________________________
-//
-ExpressionValue::~ExpressionValue()
-{
-	delete m_buffer;
-}
+	m_value (0),
+	m_valueType (valuetype),
+	m_isPure (true),
+	m_addend (0) {}
 
 // _________________________________________________________________________________________________
 //
 void ExpressionValue::convertToBuffer()
 {
 	if (isConstexpr() == false)
+	{
+		// Add the constants that were summed up for this value.
+		if (addend() < 0 and addend() != INT32_MIN)
+		{
+			buffer()->writeHeader (DataHeader::PushNumber);
+			buffer()->writeDWord (-addend());
+			buffer()->writeHeader (DataHeader::Subtract);
+		}
+		elif (addend() != 0)
+		{
+			buffer()->writeHeader (DataHeader::PushNumber);
+			buffer()->writeDWord (addend());
+			buffer()->writeHeader (DataHeader::Add);
+		}
+
+		setAddend (0);
 		return;
+	}
 
-	setBuffer (new DataBuffer);
+	setBuffer (DataBuffer::Create());
 
 	switch (m_valueType)
 	{
@@ -684,7 +700,7 @@ void ExpressionValue::convertToBuffer()
 
 		case TYPE_String:
 			buffer()->writeHeader (DataHeader::PushStringIndex);
-			buffer()->writeDWord (value());
+			buffer()->addStringReference (value());
 			break;
 
 		case TYPE_Void:
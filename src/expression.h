@@ -33,11 +33,9 @@
 #ifndef BOTC_EXPRESSION_H
 #define BOTC_EXPRESSION_H
 #include "parser.h"
+#include "dataBuffer.h"
 
-class DataBuffer;
-class ExpressionSymbol;
 class ExpressionValue;
-class ExpressionOperator;
 
 // =============================================================================
 //
@@ -68,98 +66,85 @@ named_enum ExpressionOperatorType : char
 
 // =============================================================================
 //
-enum ExpressionSymbolType
-{
-	EXPRSYM_Operator,
-	EXPRSYM_Value,
-	EXPRSYM_Colon,
-};
+// Parses an expression with precedence climbing. Operands are parsed and
+// operators applied as they are read, so each value is built once. Constant
+// operands are folded into constants right away.
+//
+// A short-circuiting expression only computes the right operand of && and ||
+// when the left one does not decide the result already.
+//
+class ExpressionValue;
 
 class Expression final
 {
 public:
-	using SymbolList = List<ExpressionSymbol*>;
-
-	Expression (BotscriptParser* parser, Lexer* lx, DataType reqtype);
-	~Expression();
+	Expression (BotscriptParser* parser, Lexer* lx, DataType reqtype,
+		bool shortcircuit = false);
 	ExpressionValue*		getResult();
 
 private:
 	BotscriptParser*		m_parser;
 	Lexer*					m_lexer;
-	SymbolList				m_symbols;
+	ExpressionValue*		m_result;
 	DataType				m_type;
 	String					m_badTokenText;
+	int						m_startPosition;
+	bool					m_isShortCircuiting;
 
-	ExpressionValue*		evaluate(); // Process the expression and yield a result
-	ExpressionSymbol*		parseSymbol();
+	ExpressionValue*		parseBinary (int maxpriority);
+	ExpressionValue*		parseUnary();
+	ExpressionValue*		parseOperand();
+	ExpressionValue*		parsePrimary();
 	String					getTokenString();
-	void					adjustOperators();
-	void					verify(); // Ensure the expr is valid
-	void					tryVerifyValue (List<bool>& verified, List< ExpressionSymbol* 
->::Iterator it);
-	ExpressionValue*		evaluateOperator (const ExpressionOperator* op,
-												const List<ExpressionValue*>& values);
-	SymbolList::Iterator	findPrioritizedOperator();
-};
-
-// =============================================================================
-//
-class ExpressionSymbol
-{
-	PROPERTY (private, ExpressionSymbolType, type, setType, STOCK_WRITE)
-
-public:
-	ExpressionSymbol (ExpressionSymbolType type) :
-		m_type (type) {}
+	ExpressionValue*		evaluateOperator (ExpressionOperatorType op,
+												ExpressionValue* const* values);
+	ExpressionValue*		simplifyOperator (ExpressionOperatorType op,
+												ExpressionValue* const* values);
 };
 
 // =============================================================================
 //
-class ExpressionOperator final : public ExpressionSymbol
-{
-	PROPERTY (public, ExpressionOperatorType, id, setID, STOCK_WRITE)
-
-public:
-	ExpressionOperator (ExpressionOperatorType id);
-};
-
-// =============================================================================
+// A value of an expression: either a constant or the bytecode that computes it.
+// A pure value can be left out or computed again without the script noticing,
+// as it calls no commands and cannot fail. The addend of a value that is not a
+// constant is added to it when its bytecode is finished, so that the constants
+// added to a value are summed up before they are written.
 //
-class ExpressionValue final : public ExpressionSymbol
+class ExpressionValue final
 {
 	PROPERTY (public, int,			value,		setValue,		STOCK_WRITE)
-	PROPERTY (public, DataBuffer*,	buffer,		setBuffer,		STOCK_WRITE)
 	PROPERTY (public, DataType,		valueType,	setValueType,	STOCK_WRITE)
+	PROPERTY (public, bool,			isPure,		setPure,		STOCK_WRITE)
+	PROPERTY (public, int32_t,		addend,		setAddend,		STOCK_WRITE)
 
 public:
 	ExpressionValue (DataType valuetype);
-	~ExpressionValue();
 
 	void					convertToBuffer();
 
-	inline ExpressionValue* clone() const
+	inline DataBuffer* buffer() const
+	{
+		return m_buffer.get();
+	}
+
+	inline void setBuffer (DataBufferPtr buffer)
+	{
+		m_buffer = std::move (buffer);
+	}
+
+	// Takes the bytecode away from this value, leaving it without a buffer.
+	inline DataBufferPtr takeBuffer()
 	{
-		return new ExpressionValue (*this);
+		return std::move (m_buffer);
 	}
 
 	inline bool isConstexpr() const
 	{
 		return buffer() == null;
 	}
-};
 
-// =============================================================================
-//
-// This class represents a ":" in the expression. It serves as the colon for the
-// ternary ?: operator. It's not an operand nor is an operator, nor can we just
-// skip it so it is its own thing here.
-//
-class ExpressionColon final : public ExpressionSymbol
-{
-public:
-	ExpressionColon() :
-		ExpressionSymbol (EXPRSYM_Colon) {}
+private:
+	DataBufferPtr			m_buffer;
 };
 
 #endif // BOTC_EXPRESSION_H
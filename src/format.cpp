@@ -123,12 +123,27 @@ String formatArgs (const String& fmtstr, const std::vector<String>& args)
 void error (const String& msg)
 {
 	Lexer* lx = Lexer::GetCurrentLexer();
-	String fileinfo;
 
 	if (lx != null and lx->hasValidToken())
+		errorAt (lx->tokenLocation(), msg);
+
+    throw std::runtime_error (msg.c_str());
+}
+
+// _________________________________________________________________________________________________
+//
+// Throws a runtime error with the message @msg, printing the given position in the
+// source of the active lexer.
+//
+void errorAt (const SourceLocation& location, const String& msg)
+{
+	Lexer* lx = Lexer::GetCurrentLexer();
+	String fileinfo;
+
+	if (lx != null)
 	{
-		Lexer::TokenInfo* tk = lx->token();
-		fileinfo = format ("%1:%2:%3: ", tk->file, tk->line, tk->column);
+		fileinfo = format ("%1:%2:%3: ", lx->fileName (location.file), lx->lineNumber (location),
+			lx->columnNumber (location));
 	}
 
     throw std::runtime_error ((fileinfo + msg).c_str());
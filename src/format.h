@@ -38,6 +38,8 @@
 #include "list.h"
 #include "enumstrings.h"
 
+struct SourceLocation;
+
 inline String MakeFormatArgument (const String& a)
 {
 	return a;
@@ -269,4 +271,9 @@ void error (const char* fmtstr, const argtypes&... args)
 //
 void error (const String& msg);
 
+//
+// Like error(), but gives the given location in the source rather than that of the current token.
+//
+void errorAt (const SourceLocation& location, const String& msg);
+
 #endif // BOTC_FORMAT_H
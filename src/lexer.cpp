@@ -33,29 +33,40 @@
 #include <cstring>
 #include <cerrno>
 #include <cassert>
+#include <algorithm>
+#include <vector>
 #include "lexer.h"
+#include "sourceBuffer.h"
+#include "tokenFile.h"
+#include "scanKernels.h"
+#include "builtinDefinitions.h"
 
-static StringList	FileNameStack;
 static Lexer*		MainLexer = null;
 
+static_assert (int (Token::NumValues) <= UINT8_MAX, "Token types must fit in the token table");
+
 // _________________________________________________________________________________________________
 //
-Lexer::Lexer()
+Lexer::Lexer() :
+	m_tokenCount (0),
+	m_isStreaming (false),
+	m_threads (1)
 {
 	ASSERT_EQ (MainLexer, null);
 
+	// File #0 stands for no file at all
+	FileInfo nofile;
+	nofile.name = "";
+	nofile.source = null;
+	nofile.text = null;
+	nofile.lastToken = -1;
+	nofile.hasLineIndex = false;
+	m_files << nofile;
+
 	// Dummy token in the beginning to set m_tokenPosition to a pos before the first actual token
-	{
-		assert(m_tokens.isEmpty());
-		TokenInfo nulltok;
-		nulltok.type = Token::Any;
-		nulltok.file = "";
-		nulltok.line = -1;
-		nulltok.column = -1;
-		nulltok.text = "";
-		m_tokens << nulltok;
-	}
-	m_tokenPosition = m_tokens.begin();
+	assert (numTokens() == 0);
+	addToken (Token::Any, 0, 0, 0, 0);
+	m_tokenPosition = 0;
 
 	MainLexer = this;
 }
@@ -64,67 +75,375 @@ Lexer::Lexer()
 //
 Lexer::~Lexer()
 {
+	for (ScannerState& state : m_scanners)
+		delete state.tokenFile;
+
+	for (FileInfo& file : m_files)
+		delete file.source;
+
 	MainLexer = null;
 }
 
 // _________________________________________________________________________________________________
 //
+//	Begins lexing the given file. Normally the whole file, with its includes, is lexed right away.
+//	In streaming mode only the file header is read here and tokens are lexed as the parser asks for
+//	them, keeping just the last StreamWindow tokens around.
+//
+//	The file may also be a token file written by writeTokens, in which case its tokens are taken
+//	as they are.
+//
+//	With more than one thread (or 0 for one per core), the files are lexed in parallel. This does
+//	not go with streaming, which then takes precedence.
+//
 void Lexer::processFile(String fileName)
 {
-	processFileInternal(fileName);
+	if (m_isStreaming == false and m_threads != 1)
+	{
+		processFileInParallel (fileName);
+	}
+	else
+	{
+		openFile (fileName, SourceBuffer::CanonicalPath (fileName));
+
+		if (m_isStreaming == false)
+		{
+			while (lexToken())
+				;
+		}
+	}
+
+	m_tokenPosition = 0;
 }
+
 // _________________________________________________________________________________________________
 //
-void Lexer::processFileInternal(String fileName)
+//	Writes the tokens that have been lexed into a token file, which can later be given to
+//	processFile or included in place of the source.
+//
+void Lexer::writeTokens (const String& fileName)
 {
-	FileNameStack << fileName;
-	FILE* fp = fopen (fileName, "rb");
+	ASSERT_EQ (m_isStreaming, false);
+	TokenFileWriter writer;
 
-	if (fp == null)
-		error ("couldn't open %1 for reading: %2", fileName, strerror (errno));
+	for (uint32_t i = 0; i < uint32_t (m_files.size()); ++i)
+	{
+		const std::vector<uint32_t>* lineBreaks = lineBreaksOf (i);
+		writer.addFile (m_files[i].name, lineBreaks ? *lineBreaks : std::vector<uint32_t>());
+	}
 
-	LexerScanner sc (fp);
-	checkFileHeader (sc);
+	for (int i = 1; i < m_tokenCount; ++i)
+	{
+		TokenInfo tok = tokenAt (i);
+		writer.addToken (tok.type, tok.location.file, tok.location.offset, tok.text());
+	}
+
+	writer.writeToFile (fileName);
+}
+
+// _________________________________________________________________________________________________
+//
+void Lexer::setStreaming (bool streaming)
+{
+	// The mode cannot be changed once lexing has started
+	ASSERT_EQ (numTokens(), 1)
+	m_isStreaming = streaming;
+}
+
+// _________________________________________________________________________________________________
+//
+void Lexer::openFile (String fileName, String path, SourceBuffer* source)
+{
+	m_openFileNames.insert (fileName);
+	FileInfo file;
+	file.name = fileName;
+	file.source = (source != null) ? source : new SourceBuffer (fileName);
+	file.text = file.source->begin();
+	file.lastToken = -1;
+	file.hasLineIndex = false;
+	m_files << file;
+
+	ScannerState state = { uint32_t (m_files.size() - 1), path, LexerScanner (*file.source),
+		CachedInclude(), null, 0, 0 };
+	state.include.first = m_tokenCount;
+
+	if (TokenFileReader::IsTokenFile (*file.source))
+	{
+		state.tokenFile = new TokenFileReader (*file.source, fileName);
+		state.firstNamedFile = m_files.size();
+
+		for (int i = 0; i < state.tokenFile->numFiles(); ++i)
+		{
+			FileInfo named;
+			named.name = state.tokenFile->fileName (i);
+			named.source = null;
+			named.text = state.tokenFile->stringPool();
+			named.lastToken = -1;
+			named.hasLineIndex = true;
+			named.lineBreaks = state.tokenFile->lineBreaks (i);
+			m_files << named;
+		}
 
-	while (sc.getNextToken())
+		m_scanners.push_back (state);
+	}
+	else
 	{
-		// Preprocessor commands:
-		if (sc.getTokenType() == Token::Hash)
+		m_scanners.push_back (state);
+		checkFileHeader (m_scanners.back().scanner);
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+//	Reads from the files being lexed until at least one token has been added to the token table.
+//	Returns false if every file has ended.
+//
+bool Lexer::lexToken()
+{
+	while (m_scanners.empty() == false)
+	{
+		if (m_scanners.back().tokenFile != null)
 		{
-			mustGetFromScanner (sc,Token::Symbol);
+			ScannerState& state = m_scanners.back();
+			const TokenFileReader& tokens = *state.tokenFile;
 
-			if (sc.getTokenText() == "include")
+			if (state.nextToken == tokens.numTokens())
 			{
-				mustGetFromScanner (sc,Token::String);
-				String fileName = sc.getTokenText();
+				closeFile();
+				continue;
+			}
+
+			int i = state.nextToken++;
+			addToken (tokens.kind (i), state.firstNamedFile + tokens.file (i), tokens.position (i),
+				tokens.offset (i), tokens.length (i));
+			return true;
+		}
 
-				if (FileNameStack.contains (fileName))
-					error ("attempted to #include %1 recursively", sc.getTokenText());
+		LexerScanner& sc = m_scanners.back().scanner;
+		uint32_t fileId = m_scanners.back().file;
 
-                processFileInternal(fileName);
+		if (sc.getNextToken() == false)
+		{
+			closeFile();
+			continue;
+		}
+
+		// Preprocessor commands:
+		if (sc.getTokenType() == Token::Hash)
+		{
+			String argument;
+			const FileInfo& file = m_files[fileId];
+
+			if (readDirective (sc, *file.source, file.name, argument) == IncludeDirective)
+			{
+				String path = SourceBuffer::CanonicalPath (argument);
+
+				if (m_onceFiles.find (path) != m_onceFiles.end())
+					continue;
+
+				if (m_openFileNames.find (argument) != m_openFileNames.end())
+					error ("attempted to #include %1 recursively", argument);
+
+				// A file that has been lexed before gives the same tokens again, so they are
+				// copied from where they were lexed the first time. Streaming mode has no cache
+				// since those tokens are long gone by then.
+				auto cached = m_includeCache.find (path);
+
+				if (cached != m_includeCache.end())
+				{
+					copyCachedTokens (cached->second);
+					continue;
+				}
+
+				// The definitions that were loaded before the compile began are not taken in
+				// again. Later includes of the file are skipped as if it had #pragma once.
+				SourceBuffer* source = new SourceBuffer (argument);
+
+				if (isLoadedDefinitionsFile (*source))
+				{
+					delete source;
+					m_onceFiles.insert (path);
+					continue;
+				}
+
+				// Note: this invalidates @sc
+				openFile (argument, path, source);
 			}
 			else
-				error ("unknown preprocessor directive \"#%1\"", sc.getTokenText());
+				m_onceFiles.insert (m_scanners.back().path);
+		}
+		elif (sc.hasOwnedText())
+		{
+			// In streaming mode the text takes the slot of its token, replacing whatever text the
+			// slot's previous token had.
+			int index = m_isStreaming ? slotOf (m_tokenCount) : m_ownedTexts.size();
+
+			if (index >= m_ownedTexts.size())
+				m_ownedTexts.resize (index + 1);
+
+			m_ownedTexts[index] = sc.getOwnedText();
+
+			addToken (sc.getTokenType(), fileId, sc.getTokenEnd(), index,
+				sc.getOwnedText().length() | OwnedTextFlag);
+			return true;
 		}
 		else
 		{
-			TokenInfo tok;
-			tok.file = fileName;
-			tok.line = sc.getLine();
-			tok.column = sc.getColumn();
-			tok.type = sc.getTokenType();
-			tok.text = sc.getTokenText();
-
-			// devf ("Token #%1: %2:%3:%4: %5 (%6)\n", mTokens.size(),
-			// 	tok.file, tok.line, tok.column, DescribeToken (&tok),
-			// 	GetTokenTypeString (tok.type));
-
-			m_tokens << tok;
+			addToken (sc.getTokenType(), fileId, sc.getTokenEnd(), sc.getTokenOffset(),
+				sc.getTokenLength());
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// _________________________________________________________________________________________________
+//
+void Lexer::closeFile()
+{
+	uint32_t fileId = m_scanners.back().file;
+	String path = m_scanners.back().path;
+	CachedInclude include = m_scanners.back().include;
+	include.end = m_tokenCount;
+	m_files[fileId].lastToken = m_tokenCount - 1;
+	delete m_scanners.back().tokenFile;
+	m_scanners.pop_back();
+	m_openFileNames.erase (m_files[fileId].name);
+
+	if (m_isStreaming)
+	{
+		m_closedFiles << fileId;
+		return;
+	}
+
+	// The file that included this one has these tokens as well. If this file has #pragma once,
+	// later includes of the including file must go without them.
+	if (m_scanners.empty() == false)
+	{
+		CachedInclude& parent = m_scanners.back().include;
+		parent.nestedFiles << m_files[fileId].name << include.nestedFiles;
+		parent.skippedRanges << include.skippedRanges;
+
+		if (m_onceFiles.find (path) != m_onceFiles.end())
+			parent.skippedRanges << std::make_pair (include.first, include.end);
+	}
+
+	m_includeCache[path] = include;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Adds the tokens that an earlier include of a file produced to the end of the token table.
+//
+void Lexer::copyCachedTokens (const CachedInclude& include)
+{
+	// Including the file again must fail the same way as lexing it again would.
+	for (const String& name : include.nestedFiles)
+	{
+		if (m_openFileNames.find (name) != m_openFileNames.end())
+			error ("attempted to #include %1 recursively", name);
+	}
+
+	List<std::pair<int, int>> skipped = include.skippedRanges;
+	std::sort (skipped.begin(), skipped.end());
+	int position = include.first;
+
+	for (int i = 0; i <= skipped.size(); ++i)
+	{
+		int end = (i < skipped.size()) ? skipped[i].first : include.end;
+
+		for (; position < end; ++position)
+		{
+			addToken (Token (m_tokens.kinds[position]), m_tokens.files[position],
+				m_tokens.positions[position], m_tokens.offsets[position],
+				m_tokens.lengths[position]);
 		}
+
+		if (i < skipped.size())
+			position = max (position, skipped[i].second);
 	}
 
-	m_tokenPosition = m_tokens.begin();
-	FileNameStack.removeOne (fileName);
+	// Whatever this file included is now included in the current file as well.
+	if (m_scanners.empty() == false)
+		m_scanners.back().include.nestedFiles << include.nestedFiles;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Makes sure that the token at the given position has been lexed. Returns false if the sources
+//	end before it.
+//
+bool Lexer::fetchToken (int position)
+{
+	while (position >= m_tokenCount)
+	{
+		if (lexToken() == false)
+			return false;
+	}
+
+	return true;
+}
+
+// _________________________________________________________________________________________________
+//
+void Lexer::addToken (Token type, uint32_t file, uint32_t position, uint32_t offset,
+	uint32_t length)
+{
+	int slot = slotOf (m_tokenCount++);
+
+	if (slot == int (m_tokens.kinds.size()))
+	{
+		m_tokens.kinds.push_back (uint8_t (type));
+		m_tokens.files.push_back (file);
+		m_tokens.positions.push_back (position);
+		m_tokens.offsets.push_back (offset);
+		m_tokens.lengths.push_back (length);
+	}
+	else
+	{
+		m_tokens.kinds[slot] = uint8_t (type);
+		m_tokens.files[slot] = file;
+		m_tokens.positions[slot] = position;
+		m_tokens.offsets[slot] = offset;
+		m_tokens.lengths[slot] = length;
+	}
+
+	// Files whose every token has left the window are no longer needed, though their line breaks
+	// are still needed for locations that were kept.
+	while (m_closedFiles.isEmpty() == false
+		and m_files[m_closedFiles[0]].lastToken < firstTokenInWindow())
+	{
+		FileInfo& closed = m_files[m_closedFiles[0]];
+		lineBreaksOf (m_closedFiles[0]);
+		delete closed.source;
+		closed.source = null;
+		closed.text = null;
+		m_closedFiles.removeAt (0);
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+Lexer::TokenInfo Lexer::tokenAt (int position) const
+{
+	TokenInfo tok;
+	int slot = slotOf (position);
+	uint32_t file = m_tokens.files[slot];
+	uint32_t length = m_tokens.lengths[slot];
+	tok.type = Token (m_tokens.kinds[slot]);
+	tok.location.file = file;
+	tok.location.offset = m_tokens.positions[slot];
+	tok.textLength = length & ~OwnedTextFlag;
+
+	if (length & OwnedTextFlag)
+		tok.textData = m_ownedTexts[m_tokens.offsets[slot]].c_str();
+	elif (m_files[file].text != null)
+		tok.textData = m_files[file].text + m_tokens.offsets[slot];
+	else
+		tok.textData = "";
+
+	return tok;
 }
 
 // ============================================================================
@@ -175,9 +494,9 @@ void Lexer::checkFileHeader (LexerScanner& sc)
 //
 bool Lexer::next (Token req)
 {
-	Iterator pos = m_tokenPosition;
+	int pos = m_tokenPosition;
 
-	if (m_tokens.isEmpty() || m_tokens.size() == 1) // is 1 due to extra dummy token in the beginning
+	if (fetchToken (m_tokenPosition + 1) == false)
 		return false;
 
 	m_tokenPosition++;
@@ -205,7 +524,8 @@ void Lexer::mustGetNext (Token tok)
 // _________________________________________________________________________________________________
 // eugh..
 //
-void Lexer::mustGetFromScanner (LexerScanner& sc, Token tt)
+void Lexer::mustGetFromScanner (LexerScanner& sc, const SourceBuffer& source,
+	const String& fileName, Token tt)
 {
 	if (sc.getNextToken() == false)
 		error ("unexpected EOF");
@@ -213,16 +533,48 @@ void Lexer::mustGetFromScanner (LexerScanner& sc, Token tt)
 	if (tt != Token::Any and sc.getTokenType() != tt)
 	{
 		// TODO
+		String text = sc.getTokenText();
 		TokenInfo tok;
 		tok.type = sc.getTokenType();
-		tok.text = sc.getTokenText();
+		tok.textData = text.c_str();
+		tok.textLength = text.length();
 
 		error ("at %1:%2: expected %3, got %4",
-			FileNameStack.last(),
-			sc.getLine(),
+			fileName,
+			1 + std::count (source.begin(), source.begin() + sc.getTokenEnd(), '\n'),
 			DescribeTokenType (tt),
-			DescribeToken (&tok));
+			DescribeToken (tok));
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+//	Reads a preprocessor directive after its '#'. For #include, the name of the file to include is
+//	put into @argument.
+//
+Lexer::Directive Lexer::readDirective (LexerScanner& sc, const SourceBuffer& source,
+	const String& fileName, String& argument)
+{
+	mustGetFromScanner (sc, source, fileName, Token::Symbol);
+
+	if (sc.getTokenText() == "include")
+	{
+		mustGetFromScanner (sc, source, fileName, Token::String);
+		argument = sc.getTokenText();
+		return IncludeDirective;
 	}
+	elif (sc.getTokenText() == "pragma")
+	{
+		mustGetFromScanner (sc, source, fileName, Token::Symbol);
+
+		if (sc.getTokenText() != "once")
+			error ("unknown pragma \"%1\"", sc.getTokenText());
+
+		return PragmaOnceDirective;
+	}
+
+	error ("unknown preprocessor directive \"#%1\"", sc.getTokenText());
+	return PragmaOnceDirective;
 }
 
 // _________________________________________________________________________________________________
@@ -262,7 +614,7 @@ int Lexer::getOneSymbol (const StringList& syms)
 	{
 		for (int i = 0; i < syms.size(); ++i)
 		{
-			if (syms[i] == token()->text)
+			if (syms[i] == tokenText())
 				return i;
 		}
 	}
@@ -282,17 +634,17 @@ void Lexer::tokenMustBe (Token tok)
 
 // _________________________________________________________________________________________________
 //
-String Lexer::DescribeTokenPrivate (Token tokType, Lexer::TokenInfo* tok)
+String Lexer::DescribeTokenPrivate (Token tokType, const Lexer::TokenInfo* tok)
 {
 	if (tokType < LastNamedToken)
 		return "\"" + LexerScanner::GetTokenString (tokType) + "\"";
 
 	switch (tokType)
 	{
-		case Token::Symbol:	return tok ? tok->text : "a symbol";
-		case Token::Number:	return tok ? tok->text : "a number";
-		case Token::String:	return tok ? ("\"" + tok->text + "\"") : "a string";
-		case Token::Any:	return tok ? tok->text : "any token";
+		case Token::Symbol:	return tok ? tok->text() : "a symbol";
+		case Token::Number:	return tok ? tok->text() : "a number";
+		case Token::String:	return tok ? ("\"" + tok->text() + "\"") : "a string";
+		case Token::Any:	return tok ? tok->text() : "any token";
 		default: break;
 	}
 
@@ -303,11 +655,11 @@ String Lexer::DescribeTokenPrivate (Token tokType, Lexer::TokenInfo* tok)
 //
 bool Lexer::peekNext (Lexer::TokenInfo* tk)
 {
-	Iterator pos = m_tokenPosition;
+	int pos = m_tokenPosition;
 	bool r = next();
 
 	if (r and tk != null)
-		*tk = *m_tokenPosition;
+		*tk = token();
 
 	m_tokenPosition = pos;
 	return r;
@@ -317,7 +669,7 @@ bool Lexer::peekNext (Lexer::TokenInfo* tk)
 //
 bool Lexer::peekNextType (Token req)
 {
-	Iterator pos = m_tokenPosition;
+	int pos = m_tokenPosition;
 	bool result = false;
 
 	if (next() and tokenType() == req)
@@ -338,28 +690,77 @@ Lexer* Lexer::GetCurrentLexer()
 //
 String Lexer::peekNextString (int a)
 {
-	if (m_tokenPosition + a >= m_tokens.end())
+	if (fetchToken (m_tokenPosition + a) == false)
 		return "";
 
-	Iterator oldpos = m_tokenPosition;
-	m_tokenPosition += a;
-	String result = token()->text;
-	m_tokenPosition = oldpos;
-	return result;
+	return tokenAt (m_tokenPosition + a).text();
+}
+
+// _________________________________________________________________________________________________
+//
+String Lexer::describeLocation (const SourceLocation& location) const
+{
+	return fileName (location.file) + ":" + lineNumber (location);
 }
 
 // _________________________________________________________________________________________________
 //
-String Lexer::describeCurrentPosition()
+//	Returns the offsets of the line breaks in the given file, finding them first if needed. Returns
+//	null if the file has no text to find them in.
+//
+const std::vector<uint32_t>* Lexer::lineBreaksOf (uint32_t file) const
 {
-	return token()->file + ":" + token()->line;
+	const FileInfo& info = m_files[file];
+
+	if (info.hasLineIndex == false)
+	{
+		if (info.source == null)
+			return null;
+
+		findLineBreaks (info.source->begin(), info.source->end(), info.lineBreaks);
+		info.hasLineIndex = true;
+	}
+
+	return &info.lineBreaks;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns the line of the given location, counting from 1, or -1 if it is not known.
+//
+int Lexer::lineNumber (const SourceLocation& location) const
+{
+	const std::vector<uint32_t>* lineBreaks = lineBreaksOf (location.file);
+
+	if (lineBreaks == null)
+		return -1;
+
+	return 1 + (std::lower_bound (lineBreaks->begin(), lineBreaks->end(), location.offset)
+		- lineBreaks->begin());
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns the column of the given location, which is its distance from the line break before it,
+//	or -1 if it is not known.
+//
+int Lexer::columnNumber (const SourceLocation& location) const
+{
+	const std::vector<uint32_t>* lineBreaks = lineBreaksOf (location.file);
+
+	if (lineBreaks == null)
+		return -1;
+
+	auto next = std::lower_bound (lineBreaks->begin(), lineBreaks->end(), location.offset);
+	uint32_t lineStart = (next == lineBreaks->begin()) ? 0 : *(next - 1);
+	return location.offset - lineStart;
 }
 
 // _________________________________________________________________________________________________
 //
 String Lexer::describeTokenPosition()
 {
-	return format ("%1 / %2", m_tokenPosition - m_tokens.begin(), m_tokens.size());
+	return format ("%1 / %2", m_tokenPosition, numTokens());
 }
 
 // _________________________________________________________________________________________________
@@ -368,6 +769,6 @@ void Lexer::mustGetSymbol (const String& a)
 {
 	mustGetNext (Token::Any);
 
-	if (token()->text != a)
-		error ("expected \"%1\", got \"%2\"", a, token()->text);
+	if (tokenText() != a)
+		error ("expected \"%1\", got \"%2\"", a, tokenText());
 }
@@ -33,23 +33,35 @@
 #ifndef BOTC_LEXER_H
 #define BOTC_LEXER_H
 
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
 #include "main.h"
 #include "lexerScanner.h"
 
+class SourceBuffer;
+class TokenFileReader;
+
 class Lexer
 {
 public:
+	// A view of one token in the token table. The text points into the source buffer of the
+	// token's file (or into the lexer's own storage for escaped string literals), so copying
+	// this does not allocate.
 	struct TokenInfo
 	{
-		Token	type;
-		String		text;
-		String		file;
-		int			line;
-		int			column;
-	};
+		Token			type;
+		SourceLocation	location;
+		const char*		textData;
+		int				textLength;
 
-	using TokenList	= List<TokenInfo>;
-	using Iterator	= TokenList::Iterator;
+		inline String text() const
+		{
+			return String (std::string (textData, textLength));
+		}
+	};
 
 public:
 	Lexer();
@@ -62,6 +74,9 @@ public:
     Lexer& operator=(const Lexer&& other) = delete;
 
 	void	processFile (String fileName);
+	void	writeTokens (const String& fileName);
+	void	setStreaming (bool streaming);
+	void	setThreads (int threads);
 	bool	next (Token req = Token::Any);
 	void	mustGetNext (Token tok);
 	void	mustGetAnyOf (const List<Token>& toks);
@@ -71,30 +86,48 @@ public:
 	bool	peekNext (TokenInfo* tk = null);
 	bool	peekNextType (Token req);
 	String	peekNextString (int a = 1);
-	String	describeCurrentPosition();
+	String	describeLocation (const SourceLocation& location) const;
+	int		lineNumber (const SourceLocation& location) const;
+	int		columnNumber (const SourceLocation& location) const;
 	String	describeTokenPosition();
 
 	static Lexer* GetCurrentLexer();
 
 	inline bool hasValidToken() const
 	{
-		return (m_tokenPosition < m_tokens.end() and m_tokenPosition >= m_tokens.begin());
+		return (m_tokenPosition < numTokens() and m_tokenPosition >= firstTokenInWindow());
 	}
 
-	inline TokenInfo* token() const
+	inline TokenInfo token() const
 	{
 		ASSERT (hasValidToken());
-		return &(*m_tokenPosition);
+		return tokenAt (m_tokenPosition);
 	}
 
 	inline bool isAtEnd() const
 	{
-		return m_tokenPosition == m_tokens.end();
+		return m_tokenPosition == numTokens();
 	}
 
 	inline Token tokenType() const
 	{
-		return token()->type;
+		ASSERT (hasValidToken());
+		return Token (m_tokens.kinds[slotOf (m_tokenPosition)]);
+	}
+
+	inline String tokenText() const
+	{
+		return token().text();
+	}
+
+	inline SourceLocation tokenLocation() const
+	{
+		return token().location;
+	}
+
+	inline const String& fileName (uint32_t file) const
+	{
+		return m_files[file].name;
 	}
 
 	inline void skip (int a = 1)
@@ -104,12 +137,13 @@ public:
 
 	inline int position()
 	{
-		return m_tokenPosition - m_tokens.begin();
+		return m_tokenPosition;
 	}
 
 	inline void setPosition (int pos)
 	{
-		m_tokenPosition = m_tokens.begin() + pos;
+		ASSERT_GT_EQ (pos, firstTokenInWindow());
+		m_tokenPosition = pos;
 	}
 
 	// If @tok is given, describes the token. If not, describes @tok_type.
@@ -118,22 +152,129 @@ public:
 		return DescribeTokenPrivate (toktype, null);
 	}
 
-	static inline String DescribeToken (TokenInfo* tok)
+	static inline String DescribeToken (const TokenInfo& tok)
 	{
-		return DescribeTokenPrivate (tok->type, tok);
+		return DescribeTokenPrivate (tok.type, &tok);
 	}
 
 private:
-	TokenList		m_tokens;
-	Iterator		m_tokenPosition;
+	// A source file that tokens were read from. Its buffer is kept for as long as the lexer
+	// lives since the tokens refer to their text by offset into it. The files named in a token
+	// file have no buffer of their own; their text is in the string pool of the token file.
+	//
+	// The offsets of the line breaks in the file are only found once a line number is asked for,
+	// or before the buffer is let go of.
+	struct FileInfo
+	{
+		String							name;
+		SourceBuffer*					source;
+		const char*						text;
+		int								lastToken;
+		mutable bool					hasLineIndex;
+		mutable std::vector<uint32_t>	lineBreaks;
+	};
+
+	// The tokens that lexing a file produced, so that including the file again can copy them
+	// instead of lexing it all over. Tokens of files that have #pragma once are left out, as the
+	// next include will not see them.
+	struct CachedInclude
+	{
+		int								first;
+		int								end;
+		List<std::pair<int, int>>		skippedRanges;
+		StringList						nestedFiles;
+	};
+
+	// A file that is being lexed, with its scanner. Includes are pushed on top of the file that
+	// included them. Token files are read with tokenFile instead of the scanner, and the files
+	// they name are numbered from firstNamedFile onwards.
+	struct ScannerState
+	{
+		uint32_t			file;
+		String				path;
+		LexerScanner		scanner;
+		CachedInclude		include;
+		TokenFileReader*	tokenFile;
+		int					nextToken;
+		uint32_t			firstNamedFile;
+	};
+
+	// The token table, stored column-wise. The text of a token is given as an offset and length
+	// into its file's source buffer. If the length has OwnedTextFlag set, the offset is an index
+	// into m_ownedTexts instead. In streaming mode the table is a ring of StreamWindow tokens.
+	struct TokenTable
+	{
+		std::vector<uint8_t>	kinds;
+		std::vector<uint32_t>	files;
+		std::vector<uint32_t>	positions;
+		std::vector<uint32_t>	offsets;
+		std::vector<uint32_t>	lengths;
+	};
+
+	struct LexedFile;
+
+	static constexpr uint32_t OwnedTextFlag = 1u << 31;
+
+	// How many of the latest tokens are kept in streaming mode. This must cover the parser's
+	// lookahead and backtracking.
+	static constexpr int StreamWindow = 256;
+
+	TokenTable					m_tokens;
+	int							m_tokenCount;
+	List<FileInfo>				m_files;
+	StringList					m_ownedTexts;
+	std::vector<ScannerState>	m_scanners;
+	List<uint32_t>				m_closedFiles;
+	std::set<String>			m_openFileNames;
+	std::set<String>			m_onceFiles;
+	std::map<String, CachedInclude>	m_includeCache;
+	int							m_tokenPosition;
+	bool						m_isStreaming;
+	int							m_threads;
+
+	void		openFile (String fileName, String path, SourceBuffer* source = null);
+	void		closeFile();
+	void		copyCachedTokens (const CachedInclude& include);
+	void		processFileInParallel (const String& fileName);
+	void		spliceFile (LexedFile& file, const String& fileName,
+					std::map<String, std::unique_ptr<LexedFile>>& files);
+	static void	lexFileOnWorker (LexedFile& file);
+	bool		lexToken();
+	bool		fetchToken (int position);
+	void		addToken (Token type, uint32_t file, uint32_t position, uint32_t offset,
+					uint32_t length);
+	TokenInfo	tokenAt (int position) const;
+	const std::vector<uint32_t>* lineBreaksOf (uint32_t file) const;
+
+	inline int numTokens() const
+	{
+		return m_tokenCount;
+	}
+
+	inline int slotOf (int position) const
+	{
+		return m_isStreaming ? (position % StreamWindow) : position;
+	}
 
-	void	processFileInternal(String fileName);
+	inline int firstTokenInWindow() const
+	{
+		return m_isStreaming ? max (m_tokenCount - StreamWindow, 0) : 0;
+	}
+
+	enum Directive
+	{
+		IncludeDirective,
+		PragmaOnceDirective,
+	};
 
 	// read a mandatory token from scanner
-	void mustGetFromScanner (LexerScanner& sc, Token tt =Token::Any);
-	void checkFileHeader (LexerScanner& sc);
+	static void mustGetFromScanner (LexerScanner& sc, const SourceBuffer& source,
+		const String& fileName, Token tt =Token::Any);
+	static Directive readDirective (LexerScanner& sc, const SourceBuffer& source,
+		const String& fileName, String& argument);
+	static void checkFileHeader (LexerScanner& sc);
 
-	static String DescribeTokenPrivate (Token tok_type, TokenInfo* tok);
+	static String DescribeTokenPrivate (Token tok_type, const TokenInfo* tok);
 };
 
 #endif // BOTC_LEXER_H
@@ -0,0 +1,353 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "lexer.h"
+#include "sourceBuffer.h"
+#include "tokenFile.h"
+#include "builtinDefinitions.h"
+
+// _________________________________________________________________________________________________
+//
+//	Something in a file lexed on a worker thread that can only be dealt with when the file's tokens
+//	are put into the token table, in include order. The event happens before the token at @token.
+//
+struct LexedFileEvent
+{
+	enum Type
+	{
+		Include,
+		PragmaOnce,
+		Error,
+	};
+
+	Type	type;
+	int		token;
+	String	argument;	// name of the included file, or the error message
+	String	path;		// canonical path of the included file
+};
+
+// _________________________________________________________________________________________________
+//
+//	The tokens of one file, lexed on its own. The text offsets are relative to the file's source
+//	buffer or, for the owned texts, to ownedTexts.
+//
+struct Lexer::LexedFile
+{
+	String					name;
+	String					path;
+	SourceBuffer*			source;
+	bool					isTokenFile;
+	bool					isInclude;
+	bool					isLoadedDefinitions;
+	std::vector<uint8_t>	kinds;
+	std::vector<uint32_t>	positions;
+	std::vector<uint32_t>	offsets;
+	std::vector<uint32_t>	lengths;
+	StringList				ownedTexts;
+	List<LexedFileEvent>	events;
+
+	// Set when the file's tokens are first added to the token table.
+	int						fileId;
+	int						firstOwnedText;
+
+	LexedFile (const String& name, const String& path) :
+		name (name),
+		path (path),
+		source (null),
+		isTokenFile (false),
+		isInclude (false),
+		isLoadedDefinitions (false),
+		fileId (-1),
+		firstOwnedText (0) {}
+
+	~LexedFile()
+	{
+		delete source;
+	}
+};
+
+// _________________________________________________________________________________________________
+//
+void Lexer::setThreads (int threads)
+{
+	ASSERT_EQ (numTokens(), 1)
+	m_threads = threads;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Lexes one file on a worker thread. Errors do not stop the compile here, since they only count
+//	if the file is reached in include order; they are stored as events instead.
+//
+void Lexer::lexFileOnWorker (LexedFile& file)
+{
+	try
+	{
+		file.source = new SourceBuffer (file.name);
+
+		// Token files are left for the main thread to read, as there is nothing to lex.
+		if (TokenFileReader::IsTokenFile (*file.source))
+		{
+			file.isTokenFile = true;
+			return;
+		}
+
+		// Neither are the definitions that were loaded before the compile began, as they are
+		// left out if included.
+		if (file.isInclude and isLoadedDefinitionsFile (*file.source))
+		{
+			file.isLoadedDefinitions = true;
+			return;
+		}
+
+		LexerScanner sc (*file.source);
+		checkFileHeader (sc);
+
+		while (sc.getNextToken())
+		{
+			if (sc.getTokenType() == Token::Hash)
+			{
+				LexedFileEvent event;
+				event.token = file.kinds.size();
+
+				if (readDirective (sc, *file.source, file.name, event.argument) == IncludeDirective)
+				{
+					event.type = LexedFileEvent::Include;
+					event.path = SourceBuffer::CanonicalPath (event.argument);
+				}
+				else
+					event.type = LexedFileEvent::PragmaOnce;
+
+				file.events << event;
+				continue;
+			}
+
+			file.kinds.push_back (uint8_t (sc.getTokenType()));
+			file.positions.push_back (sc.getTokenEnd());
+
+			if (sc.hasOwnedText())
+			{
+				file.offsets.push_back (file.ownedTexts.size());
+				file.lengths.push_back (sc.getOwnedText().length() | OwnedTextFlag);
+				file.ownedTexts << sc.getOwnedText();
+			}
+			else
+			{
+				file.offsets.push_back (sc.getTokenOffset());
+				file.lengths.push_back (sc.getTokenLength());
+			}
+		}
+	}
+	catch (std::exception& e)
+	{
+		LexedFileEvent event;
+		event.type = LexedFileEvent::Error;
+		event.token = file.kinds.size();
+		event.argument = e.what();
+		file.events << event;
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+//	Lexes the given file and everything it includes with m_threads worker threads. Each file is
+//	lexed once, by whichever worker gets to it; files are queued as their includes are found. The
+//	files are then put into the token table in include order, going through the includes,
+//	#pragma once and errors the same way as lexToken does, so the outcome does not depend on the
+//	order that the workers happened to finish in.
+//
+void Lexer::processFileInParallel (const String& fileName)
+{
+	std::map<String, std::unique_ptr<LexedFile>> files;
+	std::deque<LexedFile*> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	int pending = 1;
+
+	LexedFile* mainFile = new LexedFile (fileName, SourceBuffer::CanonicalPath (fileName));
+	files[mainFile->path].reset (mainFile);
+	queue.push_back (mainFile);
+
+	auto work = [&]()
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+
+		for (;;)
+		{
+			wake.wait (lock, [&]() { return queue.empty() == false or pending == 0; });
+
+			if (queue.empty())
+				return;
+
+			LexedFile* file = queue.front();
+			queue.pop_front();
+			lock.unlock();
+			lexFileOnWorker (*file);
+			lock.lock();
+
+			for (const LexedFileEvent& event : file->events)
+			{
+				if (event.type == LexedFileEvent::Include and files.find (event.path) == files.end())
+				{
+					LexedFile* included = new LexedFile (event.argument, event.path);
+					included->isInclude = true;
+					files[event.path].reset (included);
+					queue.push_back (included);
+					pending++;
+				}
+			}
+
+			pending--;
+			wake.notify_all();
+		}
+	};
+
+	int numThreads = m_threads;
+
+	if (numThreads <= 0)
+		numThreads = max (int (std::thread::hardware_concurrency()), 1);
+
+	std::vector<std::thread> workers;
+
+	for (int i = 0; i < numThreads; ++i)
+		workers.push_back (std::thread (work));
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	spliceFile (*mainFile, fileName, files);
+}
+
+// _________________________________________________________________________________________________
+//
+//	Adds the tokens of a file lexed on a worker to the token table, along with those of the files
+//	it includes.
+//
+void Lexer::spliceFile (LexedFile& file, const String& fileName,
+	std::map<String, std::unique_ptr<LexedFile>>& files)
+{
+	// Token files are read the same way as when lexing without threads.
+	if (file.isTokenFile)
+	{
+		auto cached = m_includeCache.find (file.path);
+
+		if (cached != m_includeCache.end())
+		{
+			copyCachedTokens (cached->second);
+		}
+		else
+		{
+			openFile (fileName, file.path);
+
+			while (lexToken())
+				;
+		}
+
+		return;
+	}
+
+	if (file.fileId == -1 and file.source != null)
+	{
+		FileInfo info;
+		info.name = fileName;
+		info.source = file.source;
+		info.text = file.source->begin();
+		info.lastToken = -1;
+		info.hasLineIndex = false;
+		m_files << info;
+		file.source = null;
+		file.fileId = m_files.size() - 1;
+		file.firstOwnedText = m_ownedTexts.size();
+		m_ownedTexts << file.ownedTexts;
+	}
+
+	m_openFileNames.insert (fileName);
+	int token = 0;
+
+	for (int i = 0; i <= file.events.size(); ++i)
+	{
+		int end = (i < file.events.size()) ? file.events[i].token : int (file.kinds.size());
+
+		for (; token < end; ++token)
+		{
+			uint32_t offset = file.offsets[token];
+
+			if (file.lengths[token] & OwnedTextFlag)
+				offset += file.firstOwnedText;
+
+			addToken (Token (file.kinds[token]), file.fileId, file.positions[token], offset,
+				file.lengths[token]);
+		}
+
+		if (i == file.events.size())
+			break;
+
+		const LexedFileEvent& event = file.events[i];
+
+		switch (event.type)
+		{
+			case LexedFileEvent::Include:
+			{
+				if (m_onceFiles.find (event.path) != m_onceFiles.end())
+					break;
+
+				if (m_openFileNames.find (event.argument) != m_openFileNames.end())
+					error ("attempted to #include %1 recursively", event.argument);
+
+				if (files[event.path]->isLoadedDefinitions)
+				{
+					m_onceFiles.insert (event.path);
+					break;
+				}
+
+				spliceFile (*files[event.path], event.argument, files);
+				break;
+			}
+
+			case LexedFileEvent::PragmaOnce:
+				m_onceFiles.insert (file.path);
+				break;
+
+			case LexedFileEvent::Error:
+				throw std::runtime_error (event.argument.c_str());
+		}
+	}
+
+	m_openFileNames.erase (fileName);
+}
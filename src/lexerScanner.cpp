@@ -34,8 +34,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
 #include "lexerScanner.h"
 #include "lexer.h"
+#include "sourceBuffer.h"
 
 static const String gTokenStrings[] =
 {
@@ -120,175 +122,332 @@ static_assert (countof (gTokenStrings) == (int) LastNamedToken + 1,
 
 // _________________________________________________________________________________________________
 //
-LexerScanner::LexerScanner (FILE* fp) :
-	m_line (1)
+//	The TokenRecognizer class is a deterministic automaton that classifies operators and keywords.
+//	Its states form a trie over gTokenStrings and are built from the table when first needed, so the
+//	table stays the only place where the token spellings are written down.
+//
+//	Operators are matched the same way the table used to be scanned: of all the token strings that
+//	prefix the input, the one listed first in gTokenStrings wins. Keywords are whole words, so a
+//	word is looked up as a complete path through the trie.
+//
+class TokenRecognizer
 {
-	long fsize, bytes;
-
-	fseek (fp, 0l, SEEK_END);
-	fsize = ftell (fp);
-	rewind (fp);
-	m_data = new char[fsize + 1];
-	m_position = m_lineBreakPosition = &m_data[0];
-	bytes = fread (m_data, 1, fsize, fp);
-	m_data[fsize] = '\0';
-	ASSERT_GT_EQ (bytes, fsize)
+public:
+	TokenRecognizer();
+	int		matchOperator (const char* text, int available, int& length) const;
+	int		matchWord (const char* text, int length) const;
+
+private:
+	struct State
+	{
+		short	transitions[128];
+		short	token;
+	};
+
+	std::vector<State> m_states;
+
+	int		addState();
+	int		transition (int state, char c) const;
+};
+
+// _________________________________________________________________________________________________
+//
+TokenRecognizer::TokenRecognizer()
+{
+	addState();
+
+	for (int i = 0; i < countof (gTokenStrings); ++i)
+	{
+		int state = 0;
+
+		for (char c : gTokenStrings[i])
+		{
+			int next = transition (state, c);
+
+			if (next == -1)
+			{
+				next = addState();
+				m_states[state].transitions[int (c)] = next;
+			}
+
+			state = next;
+		}
+
+		// If the same spelling was listed twice, the earlier entry is the one that matched.
+		if (m_states[state].token == -1)
+			m_states[state].token = i;
+	}
 }
 
 // _________________________________________________________________________________________________
 //
-LexerScanner::~LexerScanner()
+int TokenRecognizer::addState()
 {
-	delete m_data;
+	State state;
+	state.token = -1;
+
+	for (short& next : state.transitions)
+		next = -1;
+
+	m_states.push_back (state);
+	return m_states.size() - 1;
 }
 
 // _________________________________________________________________________________________________
 //
-bool LexerScanner::checkString (const char* c, int flags)
+inline int TokenRecognizer::transition (int state, char c) const
 {
-	bool r = strncmp (m_position, c, strlen (c)) == 0;
+	if (c <= 0)
+		return -1;
 
-	// There is to be a non-symbol character after words
-	if (r and (flags & FCheckWord) and IsSymbolCharacter (m_position[strlen (c)], true))
-		r = false;
+	return m_states[state].transitions[int (c)];
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns the index of the non-word token that the @available characters at @text begin with, or
+//	-1 if there is none. The length of the matched token is stored into @length.
+//
+int TokenRecognizer::matchOperator (const char* text, int available, int& length) const
+{
+	int best = -1;
 
-	// Advance the cursor unless we want to just peek
-	if (r and !(flags & FCheckPeek))
-		m_position += strlen (c);
+	for (int state = 0, i = 0; i < available and (state = transition (state, text[i])) != -1; ++i)
+	{
+		int token = m_states[state].token;
+
+		if (token != -1 and token < int (FirstNamedToken) and (best == -1 or token < best))
+		{
+			best = token;
+			length = i + 1;
+		}
+	}
 
-	return r;
+	return best;
 }
 
 // _________________________________________________________________________________________________
 //
-bool LexerScanner::getNextToken()
+//	Returns the index of the keyword that is spelled exactly like the @length characters at @text,
+//	or -1 if the word is not a keyword.
+//
+int TokenRecognizer::matchWord (const char* text, int length) const
 {
-	m_tokenText = "";
+	int state = 0;
 
-	while (isspace (*m_position))
-		skip();
+	for (int i = 0; i < length and state != -1; ++i)
+		state = transition (state, text[i]);
 
-	// Check for comments
-	if (strncmp (m_position, "//", 2) == 0)
-	{
-		m_position += 2;
+	if (state == -1 or m_states[state].token < int (FirstNamedToken))
+		return -1;
 
-        while (*m_position != '\n' && !(*m_position == '\r' && *(m_position+1) == '\n'))
-			skip();
+	return m_states[state].token;
+}
 
-		return getNextToken();
-	}
-	elif (strncmp (m_position, "/*", 2) == 0)
+// _________________________________________________________________________________________________
+//
+static const TokenRecognizer& getTokenRecognizer()
+{
+	static const TokenRecognizer recognizer;
+	return recognizer;
+}
+
+// _________________________________________________________________________________________________
+//
+LexerScanner::LexerScanner (const SourceBuffer& source) :
+	m_begin (source.begin()),
+	m_position (source.begin()),
+	m_end (source.end()),
+	m_tokenBegin (source.begin()),
+	m_tokenLength (0),
+	m_hasOwnedText (false),
+	m_classifiers (getBlockClassifiers()),
+	m_blockBegin (null),
+	m_classifiedMasks (0) {}
+
+// _________________________________________________________________________________________________
+//
+bool LexerScanner::getNextToken()
+{
+	m_hasOwnedText = false;
+
+	// Skip whitespace and comments
+	for (;;)
 	{
-		skip (2); // skip the start symbols
+		m_position = findNext (NonSpaceCharacters, m_position);
+
+		if (peek() == '/' and peek (1) == '/')
+		{
+			m_position = findNext (NewlineCharacters, m_position + 2);
+		}
+		elif (peek() == '/' and peek (1) == '*')
+		{
+			const char* end = findCommentEnd (m_position + 2);
 
-		while (strncmp (m_position, "*/", 2) != 0)
-			skip();
+			if (end == null)
+				error ("unterminated comment");
 
-		skip (2); // skip the end symbols
-		return getNextToken();
+			m_position = end + 2;
+		}
+		else
+			break;
 	}
 
-	if (*m_position == '\0')
+	if (m_position >= m_end)
 		return false;
 
-	// Check tokens
-	for (int i = 0; i < countof (gTokenStrings); ++i)
+	m_tokenBegin = m_position;
+
+	// Check keywords and symbols. A keyword must span the entire word, so the word is read first
+	// and then looked up.
+	if (IsSymbolCharacter (peek(), false))
 	{
-		int flags = 0;
+		const char* end = findNext (NonSymbolCharacters, m_position + 1);
+		m_tokenLength = end - m_position;
+		int keyword = getTokenRecognizer().matchWord (m_position, m_tokenLength);
+		m_tokenType = (keyword != -1) ? Token (keyword) : Token::Symbol;
+		m_position = end;
+		return true;
+	}
 
-		if (i >= int (FirstNamedToken))
-			flags |= FCheckWord;
+	// Check operators
+	{
+		int length;
+		int op = getTokenRecognizer().matchOperator (m_position, m_end - m_position, length);
 
-		if (checkString (gTokenStrings[i], flags))
+		if (op != -1)
 		{
-			m_tokenText = gTokenStrings[i];
-			m_tokenType = (Token) i;
+			m_tokenLength = length;
+			m_tokenType = Token (op);
+			m_position += length;
 			return true;
 		}
 	}
 
-	// Check and parse string
-	if (*m_position == '\"')
+	// Check and parse string. The text of the string is the part between the quotes, unless
+	// there are escape sequences in it, in which case the unescaped text is built separately.
+	if (peek() == '\"')
 	{
 		m_position++;
+		m_tokenBegin = m_position;
 
-		while (*m_position != '\"')
+		for (;;)
 		{
-			if (!*m_position)
+			const char* stop = findNext (StringStopCharacters, m_position);
+
+			if (m_hasOwnedText)
+				m_ownedText += String (std::string (m_position, stop - m_position));
+
+			m_position = stop;
+
+			if (m_position >= m_end)
 				error ("unterminated string");
 
-			if (checkString ("\\n"))
-			{
-				m_tokenText += '\n';
-				continue;
-			}
-			elif (checkString ("\\t"))
+			if (peek() == '"')
+				break;
+
+			char escaped = (peek (1) == 'n') ? '\n'
+				: (peek (1) == 't') ? '\t'
+				: (peek (1) == '"') ? '"'
+				: '\0';
+
+			if (escaped != '\0')
 			{
-				m_tokenText += '\t';
-				continue;
+				if (m_hasOwnedText == false)
+				{
+					m_ownedText = String (std::string (m_tokenBegin, m_position - m_tokenBegin));
+					m_hasOwnedText = true;
+				}
+
+				m_ownedText += escaped;
+				m_position += 2;
 			}
-			elif (checkString ("\\\""))
+			else
 			{
-				m_tokenText += '"';
-				continue;
-			}
+				// A backslash that does not start an escape sequence is taken as is.
+				if (m_hasOwnedText)
+					m_ownedText += '\\';
 
-			m_tokenText += *m_position++;
+				m_position++;
+			}
 		}
 
+		m_tokenLength = m_position - m_tokenBegin;
 		m_tokenType =Token::String;
-		skip(); // skip the final quote
+		m_position++; // skip the final quote
 		return true;
 	}
 
-	if (isdigit (*m_position))
+	if (isdigit (peek()))
 	{
-		while (isdigit (*m_position))
-			m_tokenText += *m_position++;
+		while (isdigit (peek()))
+			m_position++;
 
+		m_tokenLength = m_position - m_tokenBegin;
 		m_tokenType =Token::Number;
 		return true;
 	}
 
-	if (IsSymbolCharacter (*m_position, false))
-	{
-		m_tokenType =Token::Symbol;
-
-		do
-		{
-			if (!IsSymbolCharacter (*m_position, true))
-				break;
+	error ("unknown character \"%1\"", *m_position);
+	return false;
+}
 
-			m_tokenText += *m_position++;
-		} while (*m_position != '\0');
+// _________________________________________________________________________________________________
+//
+void LexerScanner::classifyBlock (CharacterClass characterClass)
+{
+	BlockClassifier classify = m_classifiers[characterClass];
 
-		return true;
+	if (m_end - m_blockBegin >= ScanBlockSize)
+	{
+		m_masks[characterClass] = classify (m_blockBegin);
+	}
+	else
+	{
+		// The last block is padded with null characters, which are neither whitespace nor part
+		// of a symbol.
+		char padded[ScanBlockSize] = {};
+		memcpy (padded, m_blockBegin, m_end - m_blockBegin);
+		m_masks[characterClass] = classify (padded);
 	}
 
-	error ("unknown character \"%1\"", *m_position);
-	return false;
+	m_classifiedMasks |= 1u << characterClass;
 }
 
 // _________________________________________________________________________________________________
 //
-void LexerScanner::skip()
+const char* LexerScanner::findNext (CharacterClass characterClass, const char* position)
 {
-    if (*m_position == '\n' || (*m_position == '\r' && *(m_position+1) == '\n'))
+	while (position < m_end)
 	{
-		m_line++;
-		m_lineBreakPosition = m_position;
+		uint64_t bits = maskAt (position, characterClass);
+		bits >>= position - m_blockBegin;
+
+		if (bits != 0)
+			return min (position + countTrailingZeros (bits), m_end);
+
+		position = m_blockBegin + ScanBlockSize;
 	}
 
-	m_position++;
+	return m_end;
 }
 
 // _________________________________________________________________________________________________
 //
-void LexerScanner::skip (int chars)
+const char* LexerScanner::findCommentEnd (const char* position)
 {
-	for (int i = 0; i < chars; ++i)
-		skip();
+	for (;;)
+	{
+		position = findNext (StarCharacters, position);
+
+		if (m_end - position < 2)
+			return null;
+
+		if (position[1] == '/')
+			return position;
+
+		position++;
+	}
 }
 
 // _________________________________________________________________________________________________
@@ -305,7 +464,7 @@ String LexerScanner::readLine()
 {
 	String line;
 
-    while (*m_position != '\n' && !(*m_position == '\r' && *(m_position+1) == '\n'))
+    while (m_position < m_end && peek() != '\n' && !(peek() == '\r' && peek (1) == '\n'))
 		line += *(m_position++);
 
 	return line;
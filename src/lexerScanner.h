@@ -35,23 +35,13 @@
 
 #include <climits>
 #include "main.h"
+#include "scanKernels.h"
+
+class SourceBuffer;
 
 class LexerScanner
 {
 public:
-	struct PositionInfo
-	{
-		char*	pos;
-		int		line;
-	};
-
-	// Flags for check_string()
-	enum
-	{
-		FCheckWord = (1 << 0),   // must be followed by whitespace
-		FCheckPeek = (1 << 1),   // don't advance cursor
-	};
-
 	static inline bool IsSymbolCharacter (char c, bool allownumbers)
 	{
 		if (allownumbers and (c >= '0' and c <= '9'))
@@ -62,24 +52,45 @@ public:
 				(c == '_');
 	}
 
-	LexerScanner (FILE* fp);
-	~LexerScanner();
+	LexerScanner (const SourceBuffer& source);
 	bool getNextToken();
 	String readLine();
 
-	inline const String& getTokenText() const
+	// Text of the token. For most tokens this is a slice of the source; string literals with
+	// escape sequences have text of their own.
+	inline String getTokenText() const
 	{
-		return m_tokenText;
+		if (m_hasOwnedText)
+			return m_ownedText;
+
+		return String (std::string (m_tokenBegin, m_tokenLength));
 	}
 
-	inline int getLine() const
+	// Position of the token's text in the source, if it has no text of its own.
+	inline long getTokenOffset() const
 	{
-		return m_line;
+		return m_tokenBegin - m_begin;
 	}
 
-	inline int getColumn() const
+	inline int getTokenLength() const
 	{
-		return m_position - m_lineBreakPosition;
+		return m_tokenLength;
+	}
+
+	inline bool hasOwnedText() const
+	{
+		return m_hasOwnedText;
+	}
+
+	inline const String& getOwnedText() const
+	{
+		return m_ownedText;
+	}
+
+	// Position in the source where the token ends.
+	inline long getTokenEnd() const
+	{
+		return m_position - m_begin;
 	}
 
 	inline Token getTokenType() const
@@ -90,27 +101,52 @@ public:
 	static String GetTokenString (Token a);
 
 private:
-	char*			m_data;
-	char*			m_position;
-	char*			m_lineBreakPosition;
-	String			m_tokenText,
-					m_lastToken;
-	Token			m_tokenType;
-	int				m_line;
+	const char*				m_begin;
+	const char*				m_position;
+	const char*				m_end;
+	const char*				m_tokenBegin;
+	int						m_tokenLength;
+	bool					m_hasOwnedText;
+	String					m_ownedText;
+	Token					m_tokenType;
+	const BlockClassifier*	m_classifiers;
+	const char*				m_blockBegin;
+	unsigned				m_classifiedMasks;
+	uint64_t				m_masks[NumCharacterClasses];
+
+	// Returns the character at the given offset from the cursor, or a null character if the
+	// offset is past the end of the source.
+	inline char		peek (int offset = 0) const
+	{
+		return (offset < m_end - m_position) ? m_position[offset] : '\0';
+	}
+
+	// Returns the mask of the given character class for the block that the given position is in.
+	// The masks are made as they are first needed.
+	inline uint64_t maskAt (const char* position, CharacterClass characterClass)
+	{
+		const char* block = m_begin + ((position - m_begin) & ~long (ScanBlockSize - 1));
 
-	bool			checkString (const char* c, int flags = 0);
+		if (block != m_blockBegin)
+		{
+			m_blockBegin = block;
+			m_classifiedMasks = 0;
+		}
 
-	// Yields a copy of the current position information.
-	PositionInfo	getPosition() const;
+		if ((m_classifiedMasks & (1u << characterClass)) == 0)
+			classifyBlock (characterClass);
+
+		return m_masks[characterClass];
+	}
 
-	// Sets the current position based on given data.
-	void			setPosition (const PositionInfo& a);
+	void			classifyBlock (CharacterClass characterClass);
 
-	// Skips one character
-	void			skip();
+	// Finds the first byte from the given position onwards that is of the given character class.
+	// Returns the end of the source if there is none.
+	const char*		findNext (CharacterClass characterClass, const char* position);
 
-	// Skips many characters
-	void			skip (int chars);
+	// Finds the "*/" that ends a block comment, or returns null if the comment is not ended.
+	const char*		findCommentEnd (const char* position);
 };
 
 #endif // BOTC_LEXER_SCANNER_H
@@ -54,6 +54,7 @@ public:
 	List (std::initializer_list<T>&& a);
 
 	inline T&						append (const T& value);
+	inline T&						append (T&& value);
 	inline Iterator					begin();
 	inline ConstIterator			begin() const;
 	inline void						clear();
@@ -85,6 +86,7 @@ public:
 	List<T>							splice (int a, int b) const;
 
 	inline List<T>&					operator<< (const T& value);
+	inline List<T>&					operator<< (T&& value);
 	inline List<T>&					operator<< (const List<T>& vals);
 	inline T&						operator[] (int n);
 	inline const T&					operator[] (int n) const;
@@ -185,6 +187,13 @@ inline T& List<T>::append (const T& value)
 	return _deque[_deque.size() - 1];
 }
 
+template<typename T>
+inline T& List<T>::append (T&& value)
+{
+	_deque.push_back (std::move (value));
+	return _deque[_deque.size() - 1];
+}
+
 template<typename T>
 void List<T>::merge (const List<T>& other)
 {
@@ -211,6 +220,13 @@ inline List<T>& List<T>::operator<< (const T& value)
 	return *this;
 }
 
+template<typename T>
+inline List<T>& List<T>::operator<< (T&& value)
+{
+	append (std::move (value));
+	return *this;
+}
+
 template<typename T>
 inline List<T>& List<T>::operator<< (const List<T>& vals)
 {
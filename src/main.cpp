@@ -40,6 +40,9 @@
 #include "gitinfo.h"
 #include "commandline.h"
 #include "enumstrings.h"
+#include "builtinDefinitions.h"
+#include "arena.h"
+#include "objectWriter.h"
 
 #ifdef GIT_HASH
 #define FULL_VERSION_STRING VERSION_STRING "-" GIT_HASH;
@@ -47,6 +50,8 @@
 #define FULL_VERSION_STRING VERSION_STRING;
 #endif
 
+// The benchmark brings its own main() and uses the rest of this file.
+#ifndef BOTC_NO_MAIN
 int main (int argc, char** argv)
 {
 	try
@@ -54,13 +59,27 @@ int main (int argc, char** argv)
 		Verbosity verboselevel (Verbosity::None);
 		bool listcommands (false);
 		bool sendhelp (false);
+		bool streaming (false);
+		int jobs (1);
+		int optimization (1);
+		String tokenfile;
+		String defsfile;
 
 		CommandLine cmdline;
 		cmdline.addOption (listcommands, 'l', "listfunctions", "List available functions");
 		cmdline.addOption (sendhelp, 'h', "help", "Print help text");
+		cmdline.addOption (streaming, 's', "stream", "Lex the source as it is parsed instead of up front");
+		cmdline.addOption (jobs, 'j', "jobs", "Lex included files on this many threads, 0 for one per core");
+		cmdline.addOption (optimization, 'O', "optimize", "Optimization level of the bytecode: 0 for none, 1 to optimize (default)");
+		cmdline.addOption (tokenfile, 't', "emit-tokens", "Write the tokens of the source into the given file instead of compiling it");
+		cmdline.addOption (defsfile, 'd', "defs", "Read the function and event definitions from the given file instead of the built-in ones");
 		cmdline.addEnumeratedOption (verboselevel, 'V', "verbose", "Output more information");
 		StringList args = cmdline.process (argc, argv);
 
+		// The definitions, variables and bytecode of the compilation are allocated from here and
+		// freed together once main returns.
+		Arena arena;
+
 		if (sendhelp)
 		{
 			// Print header
@@ -76,9 +95,10 @@ int main (int argc, char** argv)
 
 		if (listcommands)
 		{
-			BotscriptParser parser;
-			parser.setReadOnly (true);
-			parser.parseBotscript ("botc_defs.bts");
+			if (defsfile.isEmpty())
+				loadBuiltinDefinitions();
+			else
+				loadDefinitionsFile (defsfile);
 
 			for (CommandInfo* comm : getCommands())
 				print ("%1\n", comm->signature());
@@ -93,6 +113,15 @@ int main (int argc, char** argv)
 			return EXIT_FAILURE;
 		}
 
+		if (tokenfile.isEmpty() == false)
+		{
+			Lexer lexer;
+			lexer.setThreads (jobs);
+			lexer.processFile (args[0]);
+			lexer.writeTokens (tokenfile);
+			return EXIT_SUCCESS;
+		}
+
 		String outfile;
 
 		if (args.size() == 1)
@@ -100,26 +129,40 @@ int main (int argc, char** argv)
 		else
 			outfile = args[1];
 
-		// Prepare reader and writer
-		BotscriptParser* parser = new BotscriptParser;
+		// Define the functions and events. Including the same definitions from the script does
+		// not define them again.
+		if (defsfile.isEmpty())
+			loadBuiltinDefinitions();
+		else
+			loadDefinitionsFile (defsfile);
+
+		// Prepare reader and writer. The writer removes what it wrote if compiling fails.
+		ObjectWriter writer (outfile);
+		BotscriptParser parser;
+		parser.setLexerStreaming (streaming);
+		parser.setLexerThreads (jobs);
+		parser.setWriter (&writer);
+		parser.setOptimizationLevel (optimization);
+
+		// The optimizer removes code, so strings only get their slots once their code is written.
+		setStringPlacementDeferred (optimization > 0);
 
 		// We're set, begin parsing :)
 		print ("Parsing script...\n");
-		parser->parseBotscript (args[0]);
+		parser.parseBotscript (args[0]);
 		print ("Script parsed successfully.\n");
 
 		// Parse done, print statistics and write to file
-		int globalcount = parser->getHighestVarIndex (true) + 1;
-		int statelocalcount = parser->getHighestVarIndex (false) + 1;
+		int globalcount = parser.getHighestVarIndex (true) + 1;
+		int statelocalcount = parser.getHighestVarIndex (false) + 1;
 		int stringcount = countStringsInTable();
 		print ("%1 / %2 strings\n", stringcount, Limits::MaxStringlistSize);
 		print ("%1 / %2 global variable indices\n", globalcount, Limits::MaxGlobalVars);
 		print ("%1 / %2 state variable indices\n", statelocalcount, Limits::MaxStateVars);
-		print ("%1 / %2 events\n", parser->numEvents(), Limits::MaxEvents);
-		print ("%1 state%s1\n", parser->numStates());
+		print ("%1 / %2 events\n", parser.numEvents(), Limits::MaxEvents);
+		print ("%1 state%s1\n", parser.numStates());
 
-		parser->writeToFile (outfile);
-		delete parser;
+		parser.writeToFile();
 		return EXIT_SUCCESS;
 	}
 	catch (std::exception& e)
@@ -128,6 +171,7 @@ int main (int argc, char** argv)
 		return EXIT_FAILURE;
 	}
 }
+#endif // BOTC_NO_MAIN
 
 // _________________________________________________________________________________________________
 //
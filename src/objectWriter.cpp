@@ -0,0 +1,130 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <cerrno>
+#include <cstring>
+#include "objectWriter.h"
+
+#ifdef _WIN32
+# include <windows.h>
+#endif
+
+// _________________________________________________________________________________________________
+//
+ObjectWriter::ObjectWriter (const String& fileName) :
+	m_fileName (fileName),
+	m_temporaryName (fileName + ".tmp"),
+	m_position (0)
+{
+	m_file = fopen (m_temporaryName, "wb");
+
+	if (m_file == null)
+		error ("couldn't open %1 for writing: %2", m_temporaryName, strerror (errno));
+}
+
+// _________________________________________________________________________________________________
+//
+//	Throws away the temporary file if it was not committed.
+//
+ObjectWriter::~ObjectWriter()
+{
+	if (m_file != null)
+	{
+		fclose (m_file);
+		remove (m_temporaryName);
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+void ObjectWriter::checkWrite (bool succeeded)
+{
+	if (not succeeded)
+		error ("couldn't write %1: %2", m_temporaryName, strerror (errno));
+}
+
+// _________________________________________________________________________________________________
+//
+//	Appends the given bytes to the file.
+//
+void ObjectWriter::write (const char* data, int size)
+{
+	checkWrite (fwrite (data, 1, size, m_file) == size_t (size));
+	m_position += size;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Overwrites 4 bytes that were written earlier with the given value, in little-endian order.
+//
+void ObjectWriter::patch (int position, uint32_t value)
+{
+	unsigned char bytes[4];
+
+	for (int i = 0; i < 4; ++i)
+		bytes[i] = (value >> (i * 8)) & 0xFF;
+
+	checkWrite (fseek (m_file, position, SEEK_SET) == 0);
+	checkWrite (fwrite (bytes, 1, sizeof bytes, m_file) == sizeof bytes);
+	checkWrite (fseek (m_file, 0, SEEK_END) == 0);
+}
+
+// _________________________________________________________________________________________________
+//
+//	Finishes the file and moves it into the place of the object file.
+//
+void ObjectWriter::commit()
+{
+	FILE* fp = m_file;
+	m_file = null;
+
+	if (fclose (fp) != 0)
+	{
+		int closeerror = errno;
+		remove (m_temporaryName);
+		error ("couldn't write %1: %2", m_temporaryName, strerror (closeerror));
+	}
+
+#ifndef _WIN32
+	bool moved = (rename (m_temporaryName, m_fileName) == 0);
+#else
+	bool moved = MoveFileExA (m_temporaryName, m_fileName, MOVEFILE_REPLACE_EXISTING) != 0;
+#endif
+
+	if (not moved)
+	{
+		int moveerror = errno;
+		remove (m_temporaryName);
+		error ("couldn't write %1: %2", m_fileName, strerror (moveerror));
+	}
+}
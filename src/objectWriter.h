@@ -0,0 +1,80 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BOTC_OBJECTWRITER_H
+#define BOTC_OBJECTWRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include "main.h"
+
+// _________________________________________________________________________________________________
+//
+//	The ObjectWriter class writes an object file as the bytecode comes in. The bytes go to a
+//	temporary file next to the object file, which only replaces the object file once everything
+//	has been written and commit() is called. If the writer is destroyed before that, for instance
+//	because compiling failed, the temporary file is removed and any previous object file stays as
+//	it was.
+//
+class ObjectWriter
+{
+	DELETE_COPY (ObjectWriter)
+
+public:
+	ObjectWriter (const String& fileName);
+	~ObjectWriter();
+
+	void			commit();
+	void			patch (int position, uint32_t value);
+	void			write (const char* data, int size);
+
+	inline const String& fileName() const
+	{
+		return m_fileName;
+	}
+
+	inline int position() const
+	{
+		return m_position;
+	}
+
+private:
+	String			m_fileName;
+	String			m_temporaryName;
+	FILE*			m_file;
+	int				m_position;
+
+	void			checkWrite (bool succeeded);
+};
+
+#endif // BOTC_OBJECTWRITER_H
@@ -0,0 +1,790 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include "optimizer.h"
+#include "commands.h"
+
+// _________________________________________________________________________________________________
+//
+//	Reads a little-endian dword of the bytecode.
+//
+static inline int32_t loadLittleEndian (const char* source)
+{
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	int32_t value;
+	std::memcpy (&value, source, sizeof value);
+	return value;
+#else
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*> (source);
+	return int32_t (bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (uint32_t (bytes[3]) << 24));
+#endif
+}
+
+// _________________________________________________________________________________________________
+//
+static inline void appendLittleEndian (std::vector<char>& data, int32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+		data.push_back (char ((uint32_t (value) >> (i * 8)) & 0xFF));
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns how many dwords follow the given data header, or -1 if the header is not known.
+//
+static int numArgumentsOf (DataHeader header)
+{
+	switch (header)
+	{
+		case DataHeader::Command:
+		case DataHeader::CaseGoto:
+			return 2;
+
+		case DataHeader::StateIndex:
+		case DataHeader::StateName:
+		case DataHeader::Event:
+		case DataHeader::IfGoto:
+		case DataHeader::IfNotGoto:
+		case DataHeader::Goto:
+		case DataHeader::PushNumber:
+		case DataHeader::PushStringIndex:
+		case DataHeader::PushGlobalVar:
+		case DataHeader::PushLocalVar:
+		case DataHeader::IncreaseGlobalVar:
+		case DataHeader::DecreaseGlobalVar:
+		case DataHeader::AssignGlobalVar:
+		case DataHeader::AddGlobalVar:
+		case DataHeader::SubtractGlobalVar:
+		case DataHeader::MultiplyGlobalVar:
+		case DataHeader::DivideGlobalVar:
+		case DataHeader::ModGlobalVar:
+		case DataHeader::IncreaseLocalVar:
+		case DataHeader::DecreaseLocalVar:
+		case DataHeader::AssignLocalVar:
+		case DataHeader::AddLocalVar:
+		case DataHeader::SubtractLocalVar:
+		case DataHeader::MultiplyLocalVar:
+		case DataHeader::DivideLocalVar:
+		case DataHeader::ModLocalVar:
+		case DataHeader::IncreaseGlobalArray:
+		case DataHeader::DecreaseGlobalArray:
+		case DataHeader::AssignGlobalArray:
+		case DataHeader::AddGlobalArray:
+		case DataHeader::SubtractGlobalArray:
+		case DataHeader::MultiplyGlobalArray:
+		case DataHeader::DivideGlobalArray:
+		case DataHeader::ModGlobalArray:
+		case DataHeader::PushGlobalArray:
+			return 1;
+
+		case DataHeader::OnEnter:
+		case DataHeader::MainLoop:
+		case DataHeader::OnExit:
+		case DataHeader::EndOnEnter:
+		case DataHeader::EndMainLoop:
+		case DataHeader::EndOnExit:
+		case DataHeader::EndEvent:
+		case DataHeader::OrLogical:
+		case DataHeader::AndLogical:
+		case DataHeader::OrBitwise:
+		case DataHeader::EorBitwise:
+		case DataHeader::AndBitwise:
+		case DataHeader::Equals:
+		case DataHeader::NotEquals:
+		case DataHeader::LessThan:
+		case DataHeader::AtMost:
+		case DataHeader::GreaterThan:
+		case DataHeader::AtLeast:
+		case DataHeader::NegateLogical:
+		case DataHeader::LeftShift:
+		case DataHeader::RightShift:
+		case DataHeader::Add:
+		case DataHeader::Subtract:
+		case DataHeader::UnaryMinus:
+		case DataHeader::Multiply:
+		case DataHeader::Divide:
+		case DataHeader::Modulus:
+		case DataHeader::Drop:
+		case DataHeader::Swap:
+		case DataHeader::Dup:
+		case DataHeader::ArraySet:
+		case DataHeader::StringList:
+			return 0;
+
+		default:
+			return -1;
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns which argument of the given jump is the reference to where it jumps, or -1 if the
+//	header is not a jump.
+//
+static int referenceArgumentOf (DataHeader header)
+{
+	switch (header)
+	{
+		case DataHeader::IfGoto:
+		case DataHeader::IfNotGoto:
+		case DataHeader::Goto:
+			return 0;
+
+		case DataHeader::CaseGoto:
+			return 1;
+
+		default:
+			return -1;
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns whether the given data header pushes a value without doing anything else.
+//
+static bool isPlainPush (DataHeader header)
+{
+	return header == DataHeader::PushNumber
+		or header == DataHeader::PushStringIndex
+		or header == DataHeader::PushGlobalVar
+		or header == DataHeader::PushLocalVar;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns whether the given data header is part of how the object file is laid out, rather than
+//	an instruction that is run: a state name or index, the start or the end of a block of code, or
+//	the string table.
+//
+static bool isLayoutHeader (DataHeader header)
+{
+	switch (header)
+	{
+		case DataHeader::StateIndex:
+		case DataHeader::StateName:
+		case DataHeader::OnEnter:
+		case DataHeader::MainLoop:
+		case DataHeader::OnExit:
+		case DataHeader::Event:
+		case DataHeader::EndOnEnter:
+		case DataHeader::EndMainLoop:
+		case DataHeader::EndOnExit:
+		case DataHeader::EndEvent:
+		case DataHeader::StringList:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+//	Changing the state ends the block of code that does it, except in onexit where the state is
+//	being changed already.
+//
+BytecodeOptimizer::BytecodeOptimizer (Bytecode& code) :
+	m_code (code)
+{
+	CommandInfo* comm = findCommandByName ("changestate");
+	m_stateChangeCommand = (comm != null and comm->isbuiltin == false) ? comm->number : -1;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Optimizes the bytecode at the given level.
+//
+void BytecodeOptimizer::optimize (int level)
+{
+	if (level <= 0 or decode() == false)
+		return;
+
+	// One rewrite can make way for another, so keep going until nothing changes. Threading moves
+	// the jumps to other marks and removing code removes jumps, so the jump targets are found
+	// again before the peephole rules.
+	bool changed;
+
+	do
+	{
+		changed = threadJumps();
+		changed = removeUnreachableCode() or changed;
+		findJumpTargets();
+		changed = runPeepholeRules() or changed;
+	} while (changed);
+
+	encode();
+}
+
+// _________________________________________________________________________________________________
+//
+//	Splits the bytecode into instructions and finds the instructions that the marks are placed at
+//	and that the references are written in. Returns false if the bytecode is not understood.
+//
+bool BytecodeOptimizer::decode()
+{
+	const std::vector<char>& data = m_code.data;
+	int size = data.size();
+	int position = 0;
+
+	while (position < size)
+	{
+		if (position + 4 > size)
+			return false;
+
+		Instruction instr;
+		int32_t value = loadLittleEndian (&data[position]);
+
+		if (value < 0 or value >= int (DataHeader::NumValues))
+			return false;
+
+		instr.header = DataHeader (value);
+		instr.numArguments = numArgumentsOf (instr.header);
+		instr.position = position;
+		instr.rawSize = 0;
+		instr.reference = NoMark;
+		instr.pushesString = false;
+		instr.isRemoved = false;
+
+		if (instr.numArguments == -1 or position + 4 + instr.numArguments * 4 > size)
+			return false;
+
+		for (int i = 0; i < instr.numArguments; ++i)
+			instr.arguments[i] = loadLittleEndian (&data[position + 4 + i * 4]);
+
+		position += 4 + instr.numArguments * 4;
+
+		if (instr.header == DataHeader::StateName)
+		{
+			// The argument is the length of the name, which follows.
+			instr.rawSize = instr.arguments[0];
+		}
+		elif (instr.header == DataHeader::StringList)
+		{
+			// The string table ends the bytecode. It is copied as it is.
+			instr.rawSize = size - position;
+		}
+
+		if (instr.rawSize < 0 or position + instr.rawSize > size)
+			return false;
+
+		position += instr.rawSize;
+		m_instructions.push_back (instr);
+	}
+
+	// Find the instructions by position. Marks may also be placed at the end.
+	int numInstructions = m_instructions.size();
+	std::vector<int> positions (numInstructions + 1);
+
+	for (int i = 0; i < numInstructions; ++i)
+		positions[i] = m_instructions[i].position;
+
+	positions[numInstructions] = size;
+
+	for (const Bytecode::Mark& mark : m_code.marks)
+	{
+		auto it = std::lower_bound (positions.begin(), positions.end(), mark.position);
+
+		if (it == positions.end() or *it != mark.position)
+			return false;
+
+		int index = it - positions.begin();
+		m_markInstructions.push_back (index);
+		m_markTargets[mark.mark] = index;
+	}
+
+	for (const Bytecode::Reference& ref : m_code.references)
+	{
+		auto it = std::upper_bound (positions.begin(), positions.end(), ref.position);
+		int index = (it - positions.begin()) - 1;
+
+		if (index < 0 or index >= numInstructions)
+			return false;
+
+		Instruction& instr = m_instructions[index];
+		int argument = referenceArgumentOf (instr.header);
+
+		if (argument == -1 or ref.position != instr.position + 4 + argument * 4)
+			return false;
+
+		instr.reference = ref.mark;
+	}
+
+	for (const Bytecode::StringReference& ref : m_code.strings)
+	{
+		auto it = std::upper_bound (positions.begin(), positions.end(), ref.position);
+		int index = (it - positions.begin()) - 1;
+
+		if (index < 0 or index >= numInstructions)
+			return false;
+
+		Instruction& instr = m_instructions[index];
+
+		if (instr.header != DataHeader::PushStringIndex or ref.position != instr.position + 4)
+			return false;
+
+		instr.pushesString = true;
+	}
+
+	return true;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Writes the remaining instructions back into the bytecode, and moves the marks and references
+//	along. A mark of a removed instruction goes to the instruction after it. The references to the
+//	strings of removed instructions are dropped.
+//
+void BytecodeOptimizer::encode()
+{
+	std::vector<char> data;
+	data.reserve (m_code.data.size());
+	std::vector<int> positions (m_instructions.size() + 1);
+	m_code.references.clear();
+	m_code.strings.clear();
+
+	for (int i = 0; i < int (m_instructions.size()); ++i)
+	{
+		const Instruction& instr = m_instructions[i];
+		positions[i] = data.size();
+
+		if (instr.isRemoved)
+			continue;
+
+		if (instr.reference != NoMark)
+		{
+			int argument = referenceArgumentOf (instr.header);
+			m_code.references.push_back ({int (data.size()) + 4 + argument * 4, instr.reference});
+		}
+
+		if (instr.pushesString)
+			m_code.strings.push_back ({int (data.size()) + 4, instr.arguments[0]});
+
+		appendLittleEndian (data, int32_t (instr.header));
+
+		for (int j = 0; j < instr.numArguments; ++j)
+			appendLittleEndian (data, instr.arguments[j]);
+
+		const char* raw = m_code.data.data() + instr.position + 4 + instr.numArguments * 4;
+		data.insert (data.end(), raw, raw + instr.rawSize);
+	}
+
+	positions.back() = data.size();
+
+	for (size_t i = 0; i < m_code.marks.size(); ++i)
+		m_code.marks[i].position = positions[m_markInstructions[i]];
+
+	m_code.data.swap (data);
+}
+
+// _________________________________________________________________________________________________
+//
+//	Counts the marks that something jumps to: the ones the remaining instructions refer to and the
+//	ones referred to from outside of the bytecode. Marks that nothing refers to anymore no longer
+//	keep instructions apart.
+//
+void BytecodeOptimizer::findJumpTargets()
+{
+	std::unordered_set<ByteMark> jumpedTo;
+
+	for (const Instruction& instr : m_instructions)
+	{
+		if (instr.isRemoved == false and instr.reference != NoMark)
+			jumpedTo.insert (instr.reference);
+	}
+
+	m_numJumpTargetsBefore.assign (m_instructions.size() + 2, 0);
+
+	for (size_t i = 0; i < m_code.marks.size(); ++i)
+	{
+		const Bytecode::Mark& mark = m_code.marks[i];
+
+		if (mark.isReferencedElsewhere or jumpedTo.count (mark.mark))
+			m_numJumpTargetsBefore[m_markInstructions[i] + 1]++;
+	}
+
+	for (int i = 1; i < int (m_numJumpTargetsBefore.size()); ++i)
+		m_numJumpTargetsBefore[i] += m_numJumpTargetsBefore[i - 1];
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns whether anything jumps to the instructions from first to last, inclusive.
+//
+bool BytecodeOptimizer::isJumpedInto (int first, int last) const
+{
+	return m_numJumpTargetsBefore[last + 1] != m_numJumpTargetsBefore[first];
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns the first instruction from the given one onwards that is not removed.
+//
+int BytecodeOptimizer::nextInstruction (int i) const
+{
+	while (i < int (m_instructions.size()) and m_instructions[i].isRemoved)
+		++i;
+
+	return i;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Removes the instructions that can never run. The code of each block is followed from its start
+//	and from the marks that are jumped to from outside of the bytecode, through the jumps and past
+//	every instruction that does not end the block. Returns whether anything was removed.
+//
+bool BytecodeOptimizer::removeUnreachableCode()
+{
+	int numInstructions = m_instructions.size();
+	std::vector<bool> isReachable (numInstructions, false);
+	std::vector<bool> isInOnExit (numInstructions, false);
+	std::vector<int> pending;
+	bool isInBlock = false;
+	bool isInOnExitBlock = false;
+
+	for (int i = nextInstruction (0); i < numInstructions; i = nextInstruction (i + 1))
+	{
+		DataHeader header = m_instructions[i].header;
+		isInOnExit[i] = isInOnExitBlock;
+
+		if (isLayoutHeader (header))
+		{
+			isReachable[i] = true;
+
+			if (header == DataHeader::OnEnter
+				or header == DataHeader::MainLoop
+				or header == DataHeader::OnExit
+				or header == DataHeader::Event)
+			{
+				isInBlock = true;
+				isInOnExitBlock = (header == DataHeader::OnExit);
+				pending.push_back (nextInstruction (i + 1));
+			}
+			elif (header != DataHeader::StateIndex and header != DataHeader::StateName)
+			{
+				isInBlock = false;
+				isInOnExitBlock = false;
+			}
+		}
+		elif (isInBlock == false)
+		{
+			// Not in any block that is known here, so leave it be.
+			pending.push_back (i);
+		}
+	}
+
+	for (size_t i = 0; i < m_code.marks.size(); ++i)
+	{
+		if (m_code.marks[i].isReferencedElsewhere)
+			pending.push_back (nextInstruction (m_markInstructions[i]));
+	}
+
+	while (pending.empty() == false)
+	{
+		int i = pending.back();
+		pending.pop_back();
+
+		if (i >= numInstructions or isReachable[i])
+			continue;
+
+		const Instruction& instr = m_instructions[i];
+		isReachable[i] = true;
+		int target = targetOf (instr);
+
+		if (target != -1)
+			pending.push_back (target);
+
+		bool endsBlock = instr.header == DataHeader::Goto
+			or (instr.header == DataHeader::Command
+				and instr.arguments[0] == m_stateChangeCommand
+				and isInOnExit[i] == false);
+
+		if (endsBlock == false)
+			pending.push_back (nextInstruction (i + 1));
+	}
+
+	bool changed = false;
+
+	for (int i = 0; i < numInstructions; ++i)
+	{
+		if (m_instructions[i].isRemoved == false and isReachable[i] == false)
+		{
+			m_instructions[i].isRemoved = true;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns the instruction that the given jump goes to, or -1 if it is not in this bytecode.
+//
+int BytecodeOptimizer::targetOf (const Instruction& instr) const
+{
+	if (instr.reference == NoMark)
+		return -1;
+
+	auto it = m_markTargets.find (instr.reference);
+
+	if (it == m_markTargets.end())
+		return -1;
+
+	return nextInstruction (it->second);
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns a mark placed at the given instruction, placing a new one there if there is none.
+//
+ByteMark BytecodeOptimizer::markAt (int i)
+{
+	for (size_t j = 0; j < m_code.marks.size(); ++j)
+	{
+		if (nextInstruction (m_markInstructions[j]) == i)
+			return m_code.marks[j].mark;
+	}
+
+	ByteMark mark = m_code.numMarks++;
+	m_code.marks.push_back ({mark, 0, false});
+	m_markInstructions.push_back (i);
+	m_markTargets[mark] = i;
+	return mark;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Makes the jumps that land on a goto jump to where that goto goes instead, following chains of
+//	gotos to their end. A jump that lands on a number pushed only for a conditional jump to test
+//	goes straight to where that conditional jump goes with that number. Returns whether any jump
+//	was moved.
+//
+bool BytecodeOptimizer::threadJumps()
+{
+	bool changed = false;
+	int numInstructions = m_instructions.size();
+
+	for (Instruction& instr : m_instructions)
+	{
+		if (instr.isRemoved or referenceArgumentOf (instr.header) == -1)
+			continue;
+
+		ByteMark mark = instr.reference;
+		int target = targetOf (instr);
+
+		for (int hops = 0; target != -1 and target < numInstructions; ++hops)
+		{
+			// A loop of jumps never ends, so such a jump is left as it is.
+			if (hops == numInstructions)
+			{
+				mark = instr.reference;
+				break;
+			}
+
+			const Instruction& jump = m_instructions[target];
+			int test = nextInstruction (target + 1);
+
+			if (jump.header == DataHeader::Goto)
+			{
+				if (jump.reference == mark or targetOf (jump) == -1)
+					break;
+
+				mark = jump.reference;
+				target = targetOf (jump);
+			}
+			elif (jump.header == DataHeader::PushNumber
+				and test < numInstructions
+				and (m_instructions[test].header == DataHeader::IfGoto
+					or m_instructions[test].header == DataHeader::IfNotGoto)
+				and targetOf (m_instructions[test]) != -1)
+			{
+				const Instruction& condition = m_instructions[test];
+
+				if ((jump.arguments[0] != 0) == (condition.header == DataHeader::IfGoto))
+				{
+					mark = condition.reference;
+					target = targetOf (condition);
+				}
+				else
+				{
+					target = nextInstruction (test + 1);
+					mark = markAt (target);
+				}
+			}
+			else
+				break;
+		}
+
+		if (mark != instr.reference)
+		{
+			instr.reference = mark;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns whether the value pushed by the given instruction is only tested for being zero or not,
+//	so that any other non-zero value would do as well.
+//
+bool BytecodeOptimizer::isUsedAsTruthValue (int i) const
+{
+	int next = nextInstruction (i + 1);
+
+	if (next == int (m_instructions.size()) or isJumpedInto (i + 1, next))
+		return false;
+
+	switch (m_instructions[next].header)
+	{
+		case DataHeader::NegateLogical:
+		case DataHeader::AndLogical:
+		case DataHeader::OrLogical:
+		case DataHeader::IfGoto:
+		case DataHeader::IfNotGoto:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+//	Goes through the instructions once and rewrites the sequences that can be done shorter:
+//
+//	- a goto to the instruction right after it is removed,
+//	- a conditional jump to the instruction right after it, or to where the goto right after it
+//	  goes, only drops the condition,
+//	- a conditional jump on a number is either a goto or nothing,
+//	- a number push followed by a unary minus pushes the negated number instead,
+//	- a push of a constant or a variable that is dropped right away is removed along with the drop,
+//	- a logical negation followed by a conditional jump is replaced by the opposite jump,
+//	- two unary minuses in a row are removed,
+//	- two logical negations in a row are removed when the value is only used as a truth value.
+//
+//	Returns whether anything was changed.
+//
+bool BytecodeOptimizer::runPeepholeRules()
+{
+	bool changed = false;
+	int end = m_instructions.size();
+
+	for (int i = nextInstruction (0); i < end; i = nextInstruction (i + 1))
+	{
+		Instruction& first = m_instructions[i];
+		int next = nextInstruction (i + 1);
+
+		if (first.header == DataHeader::Goto and targetOf (first) == next)
+		{
+			first.isRemoved = true;
+			changed = true;
+			continue;
+		}
+
+		if ((first.header == DataHeader::IfGoto or first.header == DataHeader::IfNotGoto)
+			and (targetOf (first) == next
+				or (next != end
+					and targetOf (first) != -1
+					and m_instructions[next].header == DataHeader::Goto
+					and targetOf (m_instructions[next]) == targetOf (first))))
+		{
+			first.header = DataHeader::Drop;
+			first.numArguments = 0;
+			first.reference = NoMark;
+			changed = true;
+			continue;
+		}
+
+		// The rest combine two instructions, so nothing may jump to the second one.
+		if (next == end or isJumpedInto (i + 1, next))
+			continue;
+
+		Instruction& second = m_instructions[next];
+
+		if (first.header == DataHeader::PushNumber
+			and (second.header == DataHeader::IfGoto or second.header == DataHeader::IfNotGoto))
+		{
+			if ((first.arguments[0] != 0) == (second.header == DataHeader::IfGoto))
+				second.header = DataHeader::Goto;
+			else
+				second.isRemoved = true;
+
+			first.isRemoved = true;
+			changed = true;
+		}
+		elif (first.header == DataHeader::PushNumber and second.header == DataHeader::UnaryMinus)
+		{
+			first.arguments[0] = int32_t (0u - uint32_t (first.arguments[0]));
+			second.isRemoved = true;
+			changed = true;
+		}
+		elif (isPlainPush (first.header) and second.header == DataHeader::Drop)
+		{
+			first.isRemoved = true;
+			second.isRemoved = true;
+			changed = true;
+		}
+		elif (first.header == DataHeader::NegateLogical
+			and (second.header == DataHeader::IfGoto or second.header == DataHeader::IfNotGoto))
+		{
+			second.header = (second.header == DataHeader::IfGoto)
+				? DataHeader::IfNotGoto
+				: DataHeader::IfGoto;
+			first.isRemoved = true;
+			changed = true;
+		}
+		elif (first.header == DataHeader::UnaryMinus and second.header == DataHeader::UnaryMinus)
+		{
+			first.isRemoved = true;
+			second.isRemoved = true;
+			changed = true;
+		}
+		elif (first.header == DataHeader::NegateLogical
+			and second.header == DataHeader::NegateLogical
+			and isUsedAsTruthValue (next))
+		{
+			first.isRemoved = true;
+			second.isRemoved = true;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
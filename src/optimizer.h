@@ -0,0 +1,133 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BOTC_OPTIMIZER_H
+#define BOTC_OPTIMIZER_H
+
+#include <unordered_map>
+#include <vector>
+#include "main.h"
+
+// _________________________________________________________________________________________________
+//
+//	A piece of finished bytecode: its bytes, the marks placed in it and the references to marks and
+//	strings written into it. Positions are offsets into the bytes. A mark can also be referred to
+//	from outside of the bytecode, from references that are written elsewhere. Marks that are added
+//	to the bytecode are numbered from numMarks on.
+//
+struct Bytecode
+{
+	struct Mark
+	{
+		ByteMark	mark;
+		int			position;
+		bool		isReferencedElsewhere;
+	};
+
+	struct Reference
+	{
+		int			position;
+		ByteMark	mark;
+	};
+
+	struct StringReference
+	{
+		int			position;
+		int			number;
+	};
+
+	std::vector<char>				data;
+	std::vector<Mark>				marks;
+	std::vector<Reference>			references;
+	std::vector<StringReference>	strings;
+	int								numMarks;
+};
+
+// _________________________________________________________________________________________________
+//
+//	The BytecodeOptimizer class rewrites a piece of bytecode into fewer instructions that do the
+//	same thing. The bytecode is decoded into instructions by their data headers, the optimizations
+//	are run on those and the result is encoded back, with the marks and references moved to where
+//	their instructions ended up.
+//
+//	A mark that a reference refers to can be jumped to, so instructions are only combined when no
+//	such mark is placed between them. Bytecode that cannot be decoded, such as a call of a built-in
+//	function that is not known here, is left as it is.
+//
+//	Optimization level 1 threads jumps through the gotos and the tests of constant numbers they
+//	land on, removes the code that can never run and runs the peephole rules, which replace short
+//	sequences of instructions with shorter ones.
+//
+class BytecodeOptimizer
+{
+	DELETE_COPY (BytecodeOptimizer)
+
+public:
+	BytecodeOptimizer (Bytecode& code);
+
+	void			optimize (int level);
+
+private:
+	struct Instruction
+	{
+		DataHeader	header;
+		int			numArguments;
+		int32_t		arguments[2];
+		int			position;
+		int			rawSize;
+		ByteMark	reference;
+		bool		pushesString;
+		bool		isRemoved;
+	};
+
+	Bytecode&						m_code;
+	std::vector<Instruction>		m_instructions;
+	std::vector<int>				m_markInstructions;
+	std::vector<int>				m_numJumpTargetsBefore;
+	std::unordered_map<ByteMark, int>	m_markTargets;
+	int								m_stateChangeCommand;
+
+	bool			decode();
+	void			encode();
+	void			findJumpTargets();
+	bool			isJumpedInto (int first, int last) const;
+	bool			isUsedAsTruthValue (int i) const;
+	ByteMark		markAt (int i);
+	int				nextInstruction (int i) const;
+	bool			removeUnreachableCode();
+	bool			runPeepholeRules();
+	int				targetOf (const Instruction& instr) const;
+	bool			threadJumps();
+};
+
+#endif // BOTC_OPTIMIZER_H
@@ -40,7 +40,9 @@
 #include "list.h"
 #include "lexer.h"
 #include "dataBuffer.h"
+#include "arena.h"
 #include "expression.h"
+#include "objectWriter.h"
 
 #define SCOPE(n) (m_scopeStack[m_scopeCursor - n])
 
@@ -50,9 +52,13 @@ static const StringList g_validZandronumVersions = {"1.2", "1.3", "2.0"};
 //
 BotscriptParser::BotscriptParser() :
 	m_isReadOnly (false),
-	m_mainBuffer (new DataBuffer),
-	m_onenterBuffer (new DataBuffer),
-	m_mainLoopBuffer (new DataBuffer),
+	m_isLexerStreaming (false),
+	m_lexerThreads (1),
+	m_writer (null),
+	m_optimizationLevel (0),
+	m_mainBuffer (DataBuffer::Create()),
+	m_onenterBuffer (DataBuffer::Create()),
+	m_mainLoopBuffer (DataBuffer::Create()),
 	m_switchBuffer (nullptr),
 	m_lexer (new Lexer),
 	m_numStates (0),
@@ -97,6 +103,8 @@ void BotscriptParser::checkNotToplevel()
 void BotscriptParser::parseBotscript (String fileName)
 {
 	// Lex and preprocess the file
+	m_lexer->setStreaming (isLexerStreaming());
+	m_lexer->setThreads (lexerThreads());
 	m_lexer->processFile (fileName);
 	pushScope();
 
@@ -109,7 +117,7 @@ void BotscriptParser::parseBotscript (String fileName)
 		if (tokenIs (Token::Else) == false)
 			m_isElseAllowed = false;
 
-		switch (m_lexer->token()->type)
+		switch (m_lexer->tokenType())
 		{
 			case Token::State:
 				parseStateBlock();
@@ -194,7 +202,8 @@ void BotscriptParser::parseBotscript (String fileName)
 			default:
 			{
 				// Check if it's a command
-				CommandInfo* comm = findCommandByName (getTokenString());
+				Lexer::TokenInfo tok = m_lexer->token();
+				CommandInfo* comm = findCommandByName (tok.textData, tok.textLength);
 
 				if (comm)
 				{
@@ -209,7 +218,7 @@ void BotscriptParser::parseBotscript (String fileName)
 
 				// If nothing else, parse it as a statement
 				m_lexer->skip (-1);
-				DataBuffer* b = parseStatement();
+				DataBufferPtr b = parseStatement();
 
 				if (b == null)
 				{
@@ -217,7 +226,7 @@ void BotscriptParser::parseBotscript (String fileName)
 					error ("unknown token `%1`", getTokenString());
 				}
 
-				currentBuffer()->mergeAndDestroy (b);
+				currentBuffer()->mergeAndDestroy (std::move (b));
 				m_lexer->mustGetNext (Token::Semicolon);
 				break;
 			}
@@ -237,6 +246,9 @@ void BotscriptParser::parseBotscript (String fileName)
 		// Dump the last state's onenter and mainloop
 		writeMemberBuffers();
 
+		// The strings used by the code are known once the code is written.
+		flushMainBuffer();
+
 		// String table
 		writeStringTable();
 	}
@@ -250,7 +262,7 @@ void BotscriptParser::parseStateBlock()
 
 	if (SCOPE_State == SCOPE (0).type) {
 		// Descend down the stack
-		m_scopeCursor--;
+		popScope();
 	}
 
 	m_lexer->mustGetNext (Token::String);
@@ -271,8 +283,13 @@ void BotscriptParser::parseStateBlock()
 	// write the previous state's onenter and
 	// mainloop buffers to file now
 	if (m_currentState.isEmpty() == false)
+	{
 		writeMemberBuffers();
 
+		// The previous state is now complete, nothing refers back into it.
+		flushMainBuffer();
+	}
+
 	currentBuffer()->writeHeader (DataHeader::StateName);
 	currentBuffer()->writeString (statename);
 	currentBuffer()->writeHeader (DataHeader::StateIndex);
@@ -332,9 +349,10 @@ void BotscriptParser::parseOnEnterExit()
 //
 void BotscriptParser::parseVar()
 {
-	Variable* var = new Variable;
-	var->origin = m_lexer->describeCurrentPosition();
+	Variable* var = create<Variable>();
+	var->origin = m_lexer->tokenLocation();
 	var->isarray = false;
+	var->index = 0;
 	bool isconst = m_lexer->next (Token::Const);
 	m_lexer->mustGetAnyOf ({Token::Int,Token::Str,Token::Void});
 
@@ -363,13 +381,10 @@ void BotscriptParser::parseVar()
 			error ("arrays cannot be const");
 	}
 
-	for (Variable* var : SCOPE(0).globalVariables + SCOPE(0).localVariables)
+	if (Variable* other = m_symbols.findInInnermostScope (name))
 	{
-		if (var->name == name)
-		{
-			error ("Variable $%1 is already declared on this scope; declared at %2",
-				var->name, var->origin);
-		}
+		error ("Variable $%1 is already declared on this scope; declared at %2",
+			other->name, m_lexer->describeLocation (other->origin));
 	}
 
 	var->name = name;
@@ -416,13 +431,13 @@ void BotscriptParser::parseVar()
 
 	if (isInGlobalState()) {
 		assert(var->isGlobal());
-		SCOPE(0).globalVariables << var;
 	} else {
 		var->statename = m_currentState;
 		assert(!var->isGlobal());
-		SCOPE(0).localVariables << var;
 	}
 
+	m_symbols.add (var);
+
 	suggestHighestVarIndex (isInGlobalState(), var->index);
 	m_lexer->mustGetNext (Token::Semicolon);
 	print ("Declared %3 variable #%1 $%2\n", var->index, var->name, isInGlobalState() ? "global" : 
@@ -438,22 +453,34 @@ void BotscriptParser::parseIf()
 
 	// Condition
 	m_lexer->mustGetNext (Token::ParenStart);
-
-	// Read the expression and write it.
-	DataBuffer* c = parseExpression (TYPE_Int);
-	currentBuffer()->mergeAndDestroy (c);
-
+	int value;
+	DataBufferPtr expr = parseCondition (value);
 	m_lexer->mustGetNext (Token::ParenEnd);
 	m_lexer->mustGetNext (Token::BraceStart);
 
 	// Add a mark - to here temporarily - and add a reference to it.
 	// Upon a closing brace, the mark will be adjusted.
-	ByteMark* mark = currentBuffer()->addMark ("");
+	ByteMark mark = currentBuffer()->addMark();
 
-	// Use DataHeader::IfNotGoto - if the expression is not true, we goto the mark
-	// we just defined - and this mark will be at the end of the scope block.
-	currentBuffer()->writeHeader (DataHeader::IfNotGoto);
-	currentBuffer()->addReference (mark);
+	if (expr == null)
+	{
+		// A constant condition needs no test. If it is false, the block is jumped over.
+		if (value == 0)
+		{
+			currentBuffer()->writeHeader (DataHeader::Goto);
+			currentBuffer()->addReference (mark);
+		}
+	}
+	else
+	{
+		// Read the expression and write it.
+		currentBuffer()->mergeAndDestroy (std::move (expr));
+
+		// Use DataHeader::IfNotGoto - if the expression is not true, we goto the mark
+		// we just defined - and this mark will be at the end of the scope block.
+		currentBuffer()->writeHeader (DataHeader::IfNotGoto);
+		currentBuffer()->addReference (mark);
+	}
 
 	// Store it
 	SCOPE (0).mark1 = mark;
@@ -473,7 +500,7 @@ void BotscriptParser::parseElse()
 
 	// write down to jump to the end of the else statement
 	// Otherwise we have fall-throughs
-	SCOPE (0).mark2 = currentBuffer()->addMark ("");
+	SCOPE (0).mark2 = currentBuffer()->addMark();
 
 	// Instruction to jump to the end after if block is complete
 	currentBuffer()->writeHeader (DataHeader::Goto);
@@ -495,21 +522,35 @@ void BotscriptParser::parseWhileBlock()
 	// end. The condition is checked at the very start of the loop, if it fails,
 	// we use goto to skip to the end of the loop. At the end, we loop back to
 	// the beginning with a go-to statement.
-	ByteMark* mark1 = currentBuffer()->addMark (""); // start
-	ByteMark* mark2 = currentBuffer()->addMark (""); // end
+	ByteMark mark1 = currentBuffer()->addMark(); // start
+	ByteMark mark2 = currentBuffer()->addMark(); // end
 
 	// Condition
 	m_lexer->mustGetNext (Token::ParenStart);
-	DataBuffer* expr = parseExpression (TYPE_Int);
+	int value;
+	DataBufferPtr expr = parseCondition (value);
 	m_lexer->mustGetNext (Token::ParenEnd);
 	m_lexer->mustGetNext (Token::BraceStart);
 
-	// write condition
-	currentBuffer()->mergeAndDestroy (expr);
+	if (expr == null)
+	{
+		// A constant condition needs no test. If it is false, the loop is jumped over, and
+		// otherwise only the goto at the end loops back.
+		if (value == 0)
+		{
+			currentBuffer()->writeHeader (DataHeader::Goto);
+			currentBuffer()->addReference (mark2);
+		}
+	}
+	else
+	{
+		// write condition
+		currentBuffer()->mergeAndDestroy (std::move (expr));
 
-	// Instruction to go to the end if it fails
-	currentBuffer()->writeHeader (DataHeader::IfNotGoto);
-	currentBuffer()->addReference (mark2);
+		// Instruction to go to the end if it fails
+		currentBuffer()->writeHeader (DataHeader::IfNotGoto);
+		currentBuffer()->addReference (mark2);
+	}
 
 	// Store the needed stuff
 	SCOPE (0).mark1 = mark1;
@@ -526,7 +567,7 @@ void BotscriptParser::parseForBlock()
 
 	// Initializer
 	m_lexer->mustGetNext (Token::ParenStart);
-	DataBuffer* init = parseStatement();
+	DataBufferPtr init = parseStatement();
 
 	if (init == null)
 		error ("bad statement for initializer of for");
@@ -534,15 +575,13 @@ void BotscriptParser::parseForBlock()
 	m_lexer->mustGetNext (Token::Semicolon);
 
 	// Condition
-	DataBuffer* cond = parseExpression (TYPE_Int);
-
-	if (cond == null)
-		error ("bad statement for condition of for");
+	int value;
+	DataBufferPtr cond = parseCondition (value);
 
 	m_lexer->mustGetNext (Token::Semicolon);
 
 	// Incrementor
-	DataBuffer* incr = parseStatement();
+	DataBufferPtr incr = parseStatement();
 
 	if (incr == null)
 		error ("bad statement for incrementor of for");
@@ -551,21 +590,32 @@ void BotscriptParser::parseForBlock()
 	m_lexer->mustGetNext (Token::BraceStart);
 
 	// First, write out the initializer
-	currentBuffer()->mergeAndDestroy (init);
+	currentBuffer()->mergeAndDestroy (std::move (init));
 
 	// Init two marks
-	ByteMark* mark1 = currentBuffer()->addMark ("");
-	ByteMark* mark2 = currentBuffer()->addMark ("");
+	ByteMark mark1 = currentBuffer()->addMark();
+	ByteMark mark2 = currentBuffer()->addMark();
 
-	// Add the condition
-	currentBuffer()->mergeAndDestroy (cond);
-	currentBuffer()->writeHeader (DataHeader::IfNotGoto);
-	currentBuffer()->addReference (mark2);
+	// Add the condition. A constant one needs no test, like in while.
+	if (cond == null)
+	{
+		if (value == 0)
+		{
+			currentBuffer()->writeHeader (DataHeader::Goto);
+			currentBuffer()->addReference (mark2);
+		}
+	}
+	else
+	{
+		currentBuffer()->mergeAndDestroy (std::move (cond));
+		currentBuffer()->writeHeader (DataHeader::IfNotGoto);
+		currentBuffer()->addReference (mark2);
+	}
 
 	// Store the marks and incrementor
 	SCOPE (0).mark1 = mark1;
 	SCOPE (0).mark2 = mark2;
-	SCOPE (0).buffer1 = incr;
+	SCOPE (0).buffer1 = std::move (incr);
 	SCOPE (0).type = SCOPE_For;
 }
 
@@ -576,7 +626,7 @@ void BotscriptParser::parseDoBlock()
 	checkNotToplevel();
 	pushScope();
 	m_lexer->mustGetNext (Token::BraceStart);
-	SCOPE (0).mark1 = currentBuffer()->addMark ("");
+	SCOPE (0).mark1 = currentBuffer()->addMark();
 	SCOPE (0).type = SCOPE_Do;
 }
 
@@ -596,16 +646,30 @@ void BotscriptParser::parseSwitchBlock()
 	// casemark2: ...
 	// casemark3: ...
 	// mark1: // end mark
+	//
+	// If the expression is a constant, nothing is pushed and the case
+	// that matches it is jumped to right away.
 
 	checkNotToplevel();
 	pushScope();
 	m_lexer->mustGetNext (Token::ParenStart);
-	currentBuffer()->mergeAndDestroy (parseExpression (TYPE_Int));
+	int value;
+	DataBufferPtr expr = parseCondition (value, false);
 	m_lexer->mustGetNext (Token::ParenEnd);
 	m_lexer->mustGetNext (Token::BraceStart);
+
+	if (expr == null)
+	{
+		SCOPE (0).isConstantSwitch = true;
+		SCOPE (0).switchValue = value;
+	}
+	else
+		currentBuffer()->mergeAndDestroy (std::move (expr));
+
 	SCOPE (0).type = SCOPE_Switch;
-	SCOPE (0).mark1 = currentBuffer()->addMark (""); // end mark
-	SCOPE (0).buffer1 = null; // default header
+	SCOPE (0).outerSwitchBuffer = m_switchBuffer;
+	SCOPE (0).mark1 = currentBuffer()->addMark(); // end mark
+	SCOPE (0).buffer1.reset(); // default header
 }
 
 // _________________________________________________________________________________________________
@@ -620,7 +684,7 @@ void BotscriptParser::parseSwitchCase()
 	// expressions here.
 	bool isNegative = m_lexer->next(Token::Minus);
 	m_lexer->mustGetNext (Token::Number);
-	int num = m_lexer->token()->text.toLong();
+	int num = m_lexer->tokenText().toLong();
 	if (isNegative) {
 		num = -num;
 	}
@@ -640,12 +704,28 @@ void BotscriptParser::parseSwitchCase()
 	// for the case block that this heralds, and takes care
 	// of buffering setup and stuff like that.
 	//
-	// We null the switch buffer for the case-go-to statement as
-	// we want it all under the switch, not into the case-buffers.
-	m_switchBuffer = nullptr;
-	currentBuffer()->writeHeader (DataHeader::CaseGoto);
-	currentBuffer()->writeDWord (num);
-	addSwitchCase (null);
+	// We go back to the buffer of the switch itself for the
+	// case-go-to statement as we want it all under the switch,
+	// not into the case-buffers.
+	m_switchBuffer = SCOPE (0).outerSwitchBuffer;
+
+	if (SCOPE (0).isConstantSwitch == false)
+	{
+		currentBuffer()->writeHeader (DataHeader::CaseGoto);
+		currentBuffer()->writeDWord (num);
+		addSwitchCase (currentBuffer());
+	}
+	elif (num == SCOPE (0).switchValue)
+	{
+		currentBuffer()->writeHeader (DataHeader::Goto);
+		addSwitchCase (currentBuffer());
+	}
+	else
+	{
+		// Nothing goes to a case that does not match a constant.
+		addSwitchCase (null);
+	}
+
 	SCOPE (0).casecursor->number = num;
 }
 
@@ -668,9 +748,12 @@ void BotscriptParser::parseSwitchDefault()
 	// and is only popped when case succeeds, we have
 	// to pop it with DataHeader::Drop manually if we end up in
 	// a default.
-	DataBuffer* buf = new DataBuffer;
-	SCOPE (0).buffer1 = buf;
-	buf->writeHeader (DataHeader::Drop);
+	SCOPE (0).buffer1 = DataBuffer::Create();
+	DataBuffer* buf = SCOPE (0).buffer1.get();
+
+	if (SCOPE (0).isConstantSwitch == false)
+		buf->writeHeader (DataHeader::Drop);
+
 	buf->writeHeader (DataHeader::Goto);
 	addSwitchCase (buf);
 }
@@ -768,7 +851,7 @@ void BotscriptParser::parseBlockEnd()
 
 			case SCOPE_For:
 			{	// write the incrementor at the end of the loop block
-				currentBuffer()->mergeAndDestroy (SCOPE (0).buffer1);
+				currentBuffer()->mergeAndDestroy (std::move (SCOPE (0).buffer1));
 			}
 			case SCOPE_While:
 			{	// write down the instruction to go back to the start of the loop
@@ -784,34 +867,46 @@ void BotscriptParser::parseBlockEnd()
 			{
 				m_lexer->mustGetNext (Token::While);
 				m_lexer->mustGetNext (Token::ParenStart);
-				DataBuffer* expr = parseExpression (TYPE_Int);
+				int value;
+				DataBufferPtr expr = parseCondition (value);
 				m_lexer->mustGetNext (Token::ParenEnd);
 				m_lexer->mustGetNext (Token::Semicolon);
 
-				// If the condition runs true, go back to the start.
-				currentBuffer()->mergeAndDestroy (expr);
-				currentBuffer()->writeHeader (DataHeader::IfGoto);
-				currentBuffer()->addReference (SCOPE (0).mark1);
+				// If the condition runs true, go back to the start. A constant one needs
+				// no test.
+				if (expr == null)
+				{
+					if (value != 0)
+					{
+						currentBuffer()->writeHeader (DataHeader::Goto);
+						currentBuffer()->addReference (SCOPE (0).mark1);
+					}
+				}
+				else
+				{
+					currentBuffer()->mergeAndDestroy (std::move (expr));
+					currentBuffer()->writeHeader (DataHeader::IfGoto);
+					currentBuffer()->addReference (SCOPE (0).mark1);
+				}
 				break;
 			}
 
 			case SCOPE_Switch:
 			{
-				// Switch closes. Move down to the record buffer of
-				// the lower block.
-				if (SCOPE (1).casecursor != null)
-					m_switchBuffer = SCOPE (1).casecursor->data;
-				else
-					m_switchBuffer = nullptr;
+				// Switch closes. Move down to the buffer that the
+				// switch was written into.
+				m_switchBuffer = SCOPE (0).outerSwitchBuffer;
 
 				// If there was a default in the switch, write its header down now.
 				// If not, write instruction to jump to the end of switch after
 				// the headers (thus won't fall-through if no case matched)
 				if (SCOPE (0).buffer1)
-					currentBuffer()->mergeAndDestroy (SCOPE (0).buffer1);
+					currentBuffer()->mergeAndDestroy (std::move (SCOPE (0).buffer1));
 				else
 				{
-					currentBuffer()->writeHeader (DataHeader::Drop);
+					if (SCOPE (0).isConstantSwitch == false)
+						currentBuffer()->writeHeader (DataHeader::Drop);
+
 					currentBuffer()->writeHeader (DataHeader::Goto);
 					currentBuffer()->addReference (SCOPE (0).mark1);
 				}
@@ -821,7 +916,7 @@ void BotscriptParser::parseBlockEnd()
 				for (CaseInfo& info : SCOPE (0).cases)
 				{
 					currentBuffer()->adjustMark (info.mark);
-					currentBuffer()->mergeAndDestroy (info.data);
+					currentBuffer()->mergeAndDestroy (std::move (info.data));
 				}
 
 				// Move the closing mark here
@@ -835,7 +930,7 @@ void BotscriptParser::parseBlockEnd()
 		}
 
 		// Descend down the stack
-		m_scopeCursor--;
+		popScope();
 		return;
 	}
 
@@ -861,13 +956,14 @@ void BotscriptParser::parseBlockEnd()
 //
 void BotscriptParser::parseEventdef()
 {
-	EventDefinition* e = new EventDefinition;
+	EventDefinition* e = create<EventDefinition>();
 
 	m_lexer->mustGetNext (Token::Number);
 	e->number = getTokenString().toLong();
 	m_lexer->mustGetNext (Token::Colon);
 	m_lexer->mustGetNext (Token::Symbol);
-	e->name = m_lexer->token()->text;
+	e->name = m_lexer->tokenText();
+	e->ispreloaded = isReadOnly();
 	m_lexer->mustGetNext (Token::ParenStart);
 	m_lexer->mustGetNext (Token::ParenEnd);
 	m_lexer->mustGetNext (Token::Semicolon);
@@ -878,23 +974,26 @@ void BotscriptParser::parseEventdef()
 //
 void BotscriptParser::parseFuncdef(bool isBuiltin)
 {
-	CommandInfo* comm = new CommandInfo;
-	comm->origin = m_lexer->describeCurrentPosition();
+	CommandInfo* comm = create<CommandInfo>();
+	comm->origin = m_lexer->tokenLocation();
 
 	// Return value
 	m_lexer->mustGetAnyOf ({Token::Int,Token::Void,Token::Bool,Token::Str});
-	comm->returnvalue = getTypeByName (m_lexer->token()->text); // TODO
+	comm->returnvalue = getTypeByName (m_lexer->tokenText()); // TODO
 	ASSERT_NE (comm->returnvalue, TYPE_Unknown);
 
 	// Number
 	m_lexer->mustGetNext (Token::Number);
-	comm->number = m_lexer->token()->text.toLong();
+	comm->number = m_lexer->tokenText().toLong();
 	comm->isbuiltin = isBuiltin;
+
+	// A read-only parse loads the definitions up front, before the script.
+	comm->ispreloaded = isReadOnly();
 	m_lexer->mustGetNext (Token::Colon);
 
 	// Name
 	m_lexer->mustGetNext (Token::Symbol);
-	comm->name = m_lexer->token()->text;
+	comm->name = m_lexer->tokenText();
 
 	// Arguments
 	m_lexer->mustGetNext (Token::ParenStart);
@@ -907,13 +1006,13 @@ void BotscriptParser::parseFuncdef(bool isBuiltin)
 
 		CommandArgument arg;
 		m_lexer->mustGetAnyOf ({Token::Int,Token::Bool,Token::Str});
-		DataType type = getTypeByName (m_lexer->token()->text); // TODO
+		DataType type = getTypeByName (m_lexer->tokenText()); // TODO
 		ASSERT_NE (type, TYPE_Unknown)
 		ASSERT_NE (type, TYPE_Void)
 		arg.type = type;
 
 		m_lexer->mustGetNext (Token::Symbol);
-		arg.name = m_lexer->token()->text;
+		arg.name = m_lexer->tokenText();
 
 		// If this is an optional parameter, we need the default value.
 		if (comm->minargs < comm->args.size() or m_lexer->peekNextType (Token::Assign))
@@ -935,7 +1034,7 @@ void BotscriptParser::parseFuncdef(bool isBuiltin)
 					break;
 			}
 
-			arg.defvalue = m_lexer->token()->text.toLong();
+			arg.defvalue = m_lexer->tokenText().toLong();
 		}
 		else
 			comm->minargs++;
@@ -960,9 +1059,9 @@ void BotscriptParser::parseBuiltinDef()
 //
 // Parses a command call
 //
-DataBuffer* BotscriptParser::parseCommand (CommandInfo* comm)
+DataBufferPtr BotscriptParser::parseCommand (CommandInfo* comm)
 {
-	DataBuffer* r = new DataBuffer (64);
+	DataBufferPtr r = DataBuffer::Create (64);
 
 	if (m_currentMode == ParserMode::TopLevel and comm->returnvalue == TYPE_Void)
 		error ("command call at top level");
@@ -1180,10 +1279,10 @@ DataHeader BotscriptParser::getAssigmentDataHeader (AssignmentOperator op, Varia
 // by an assignment operator, followed by an expression value. Expects current
 // token to be the name of the variable, and expects the variable to be given.
 //
-DataBuffer* BotscriptParser::parseAssignment (Variable* var)
+DataBufferPtr BotscriptParser::parseAssignment (Variable* var)
 {
-	DataBuffer* retbuf = new DataBuffer;
-	DataBuffer* arrayindex = null;
+	DataBufferPtr retbuf = DataBuffer::Create();
+	DataBufferPtr arrayindex;
 
 	if (var->writelevel != WRITE_Mutable)
 		error ("cannot alter read-only variable $%1", var->name);
@@ -1193,7 +1292,7 @@ DataBuffer* BotscriptParser::parseAssignment (Variable* var)
 		m_lexer->mustGetNext (Token::BracketStart);
 		Expression expr (this, m_lexer, TYPE_Int);
 		expr.getResult()->convertToBuffer();
-		arrayindex = expr.getResult()->buffer()->clone();
+		arrayindex = expr.getResult()->takeBuffer();
 		m_lexer->mustGetNext (Token::BracketEnd);
 	}
 
@@ -1204,13 +1303,12 @@ DataBuffer* BotscriptParser::parseAssignment (Variable* var)
 		error ("can't alter variables at top level");
 
 	if (var->isarray)
-		retbuf->mergeAndDestroy (arrayindex);
+		retbuf->mergeAndDestroy (std::move (arrayindex));
 
 	// Parse the right operand
 	if (oper != ASSIGNOP_Increase and oper != ASSIGNOP_Decrease)
 	{
-		DataBuffer* expr = parseExpression (var->type);
-		retbuf->mergeAndDestroy (expr);
+		retbuf->mergeAndDestroy (parseExpression (var->type));
 	}
 
 #if 0
@@ -1239,8 +1337,7 @@ void BotscriptParser::pushScope (bool noreset)
 
 	if (m_scopeStack.size() < m_scopeCursor + 1)
 	{
-		ScopeInfo newscope;
-		m_scopeStack << newscope;
+		m_scopeStack << ScopeInfo();
 		noreset = false;
 	}
 
@@ -1248,27 +1345,34 @@ void BotscriptParser::pushScope (bool noreset)
 	{
 		ScopeInfo* info = &SCOPE (0);
 		info->type = SCOPE_Unknown;
-		info->mark1 = null;
-		info->mark2 = null;
-		info->buffer1 = null;
+		info->mark1 = NoMark;
+		info->mark2 = NoMark;
+		info->buffer1.reset();
 		info->cases.clear();
 		info->casecursor = null;
+		info->isConstantSwitch = false;
 	}
 
 	// Reset variable stuff in any case
 	SCOPE(0).globalVarIndexBase = (m_scopeCursor == 0) ? 0 : SCOPE(1).globalVarIndexBase;
 	SCOPE(0).localVarIndexBase = (m_scopeCursor == 0) ? 0 : SCOPE(1).localVarIndexBase;
+	m_symbols.pushScope();
+}
 
-	for (Variable* var : SCOPE(0).globalVariables + SCOPE(0).localVariables)
-		delete var;
-
-	SCOPE(0).localVariables.clear();
-	SCOPE(0).globalVariables.clear();
+// _________________________________________________________________________________________________
+//
+// Leaves the current scope. Its variables go out of sight but are not freed, as they belong to the
+// arena.
+//
+void BotscriptParser::popScope()
+{
+	m_symbols.popScope();
+	m_scopeCursor--;
 }
 
 // _________________________________________________________________________________________________
 //
-DataBuffer* BotscriptParser::parseExpression (DataType reqtype, bool fromhere)
+DataBufferPtr BotscriptParser::parseExpression (DataType reqtype, bool fromhere)
 {
 	// hehe
 	if (fromhere)
@@ -1277,14 +1381,35 @@ DataBuffer* BotscriptParser::parseExpression (DataType reqtype, bool fromhere)
 	Expression expr (this, m_lexer, reqtype);
 	expr.getResult()->convertToBuffer();
 
-	// The buffer will be destroyed once the function ends so we need to
-	// clone it now.
-	return expr.getResult()->buffer()->clone();
+	// Take the bytecode over from the expression, it is not needed there any more.
+	return expr.getResult()->takeBuffer();
 }
 
 // _________________________________________________________________________________________________
 //
-DataBuffer* BotscriptParser::parseStatement()
+// Parses the condition of an if, a loop or a switch. When optimizing, a condition that is a
+// constant is not written at all: null is returned and the value is stored instead. The && and ||
+// operators of a condition that is tested for truth, rather than matched against the cases of a
+// switch, also only compute their right operand when it is needed then.
+//
+DataBufferPtr BotscriptParser::parseCondition (int& value, bool istest)
+{
+	Expression expr (this, m_lexer, TYPE_Int, istest and optimizationLevel() > 0);
+	ExpressionValue* result = expr.getResult();
+
+	if (optimizationLevel() > 0 and result->isConstexpr())
+	{
+		value = result->value();
+		return null;
+	}
+
+	result->convertToBuffer();
+	return result->takeBuffer();
+}
+
+// _________________________________________________________________________________________________
+//
+DataBufferPtr BotscriptParser::parseStatement()
 {
 	// If it's a variable, expect assignment.
 	if (m_lexer->next (Token::DollarSign))
@@ -1311,21 +1436,21 @@ void BotscriptParser::addSwitchCase (DataBuffer* casebuffer)
 	CaseInfo casedata;
 
 	// Init a mark for the case buffer
-	ByteMark* casemark = currentBuffer()->addMark ("");
+	ByteMark casemark = currentBuffer()->addMark();
 	casedata.mark = casemark;
 
 	// Add a reference to the mark. "case" and "default" both
-	// add the necessary bytecode before the reference.
+	// add the necessary bytecode before the reference. A case
+	// that is never jumped to has no buffer for it.
 	if (casebuffer != null)
 		casebuffer->addReference (casemark);
-	else
-		currentBuffer()->addReference (casemark);
 
 	// Init a buffer for the case block and tell the object
 	// writer to record all written data to it.
-	casedata.data = m_switchBuffer = new DataBuffer;
+	casedata.data = DataBuffer::Create();
+	m_switchBuffer = casedata.data.get();
 	List<CaseInfo> &cases = SCOPE(0).cases;
-	cases << casedata;
+	cases << std::move (casedata);
 	info->casecursor = &*(cases.end() - 1);
 }
 
@@ -1340,15 +1465,17 @@ bool BotscriptParser::tokenIs (Token a)
 //
 String BotscriptParser::getTokenString()
 {
-	return m_lexer->token()->text;
+	return m_lexer->tokenText();
 }
 
 // _________________________________________________________________________________________________
 //
 String BotscriptParser::describePosition() const
 {
-	Lexer::TokenInfo* tok = m_lexer->token();
-	return tok->file + ":" + String (tok->line) + ":" + String (tok->column);
+	SourceLocation location = m_lexer->tokenLocation();
+	return m_lexer->fileName (location.file) + ":"
+		+ String::fromNumber (m_lexer->lineNumber (location)) + ":"
+		+ String::fromNumber (m_lexer->columnNumber (location));
 }
 
 // _________________________________________________________________________________________________
@@ -1361,12 +1488,12 @@ DataBuffer* BotscriptParser::currentBuffer()
 		return m_switchBuffer;
 
 	if (m_currentMode == ParserMode::MainLoop)
-		return m_mainLoopBuffer;
+		return m_mainLoopBuffer.get();
 
 	if (m_currentMode == ParserMode::Onenter)
-		return m_onenterBuffer;
+		return m_onenterBuffer.get();
 
-	return m_mainBuffer;
+	return m_mainBuffer.get();
 }
 
 // _________________________________________________________________________________________________
@@ -1381,12 +1508,12 @@ void BotscriptParser::writeMemberBuffers()
 	}
 
 	// Write the onenter and mainloop buffers, in that order in particular.
-	for (DataBuffer** bufp : List<DataBuffer**> ({&m_onenterBuffer, &m_mainLoopBuffer}))
+	for (DataBufferPtr* bufp : List<DataBufferPtr*> ({&m_onenterBuffer, &m_mainLoopBuffer}))
 	{
-		currentBuffer()->mergeAndDestroy (*bufp);
+		currentBuffer()->mergeAndDestroy (std::move (*bufp));
 
 		// Clear the buffer afterwards for potential next state
-		*bufp = new DataBuffer;
+		*bufp = DataBuffer::Create();
 	}
 
 	// Next state definitely has no mainloop yet
@@ -1404,6 +1531,14 @@ void BotscriptParser::writeStringTable()
 	if (stringcount == 0)
 		return;
 
+	// Make room for the whole table at once
+	int tablesize = m_mainBuffer->writtenSize() + 8;
+
+	for (int i = 0; i < stringcount; i++)
+		tablesize += 4 + getStringTable()[i].length();
+
+	m_mainBuffer->reserve (tablesize);
+
 	// Write header
 	m_mainBuffer->writeHeader (DataHeader::StringList);
 	m_mainBuffer->writeDWord (stringcount);
@@ -1415,26 +1550,24 @@ void BotscriptParser::writeStringTable()
 
 // _________________________________________________________________________________________________
 //
-// Write the compiled bytecode to a file
+// Optimizes and writes out what has been compiled since the last flush, if
+// there is a writer to write it to.
 //
-void BotscriptParser::writeToFile (String outfile)
+void BotscriptParser::flushMainBuffer()
 {
-	FILE* fp = fopen (outfile, "wb");
-
-	if (fp == null)
-		error ("couldn't open %1 for writing: %2", outfile, std::strerror (errno));
-
-	// First, resolve references
-	for (MarkReference* ref : m_mainBuffer->references())
-	{
-		for (int i = 0; i < 4; ++i)
-			m_mainBuffer->buffer()[ref->pos + i] = (ref->target->pos >> (8 * i)) & 0xFF;
-	}
+	if (writer() != null)
+		m_mainBuffer->flush (*writer(), optimizationLevel());
+}
 
-	// Then, dump the main buffer to the file
-	fwrite (m_mainBuffer->buffer(), 1, m_mainBuffer->writtenSize(), fp);
-	print ("-- %1 byte%s1 written to %2\n", m_mainBuffer->writtenSize(), outfile);
-	fclose (fp);
+// _________________________________________________________________________________________________
+//
+// Write the rest of the compiled bytecode and put the object file in place
+//
+void BotscriptParser::writeToFile()
+{
+	flushMainBuffer();
+	writer()->commit();
+	print ("-- %1 byte%s1 written to %2\n", writer()->position(), writer()->fileName());
 }
 
 // _________________________________________________________________________________________________
@@ -1444,16 +1577,7 @@ void BotscriptParser::writeToFile (String outfile)
 //
 Variable* BotscriptParser::findVariable (const String& name)
 {
-	for (int i = m_scopeCursor; i >= 0; --i)
-	{
-		for (Variable* var : m_scopeStack[i].globalVariables + m_scopeStack[i].localVariables)
-		{
-			if (var->name == name)
-				return var;
-		}
-	}
-
-	return null;
+	return m_symbols.find (name);
 }
 
 // _________________________________________________________________________________________________
@@ -38,9 +38,11 @@
 #include "commands.h"
 #include "lexerScanner.h"
 #include "tokens.h"
+#include "symbolTable.h"
+#include "dataBuffer.h"
 
-class DataBuffer;
 class Lexer;
+class ObjectWriter;
 struct Variable;
 
 // _________________________________________________________________________________________________
@@ -114,7 +116,7 @@ struct Variable
 	int				index;
 	Writability		writelevel;
 	int				value;
-	String			origin;
+	SourceLocation	origin;
 	bool			isarray;
 
 	inline bool isGlobal() const
@@ -127,9 +129,9 @@ struct Variable
 //
 struct CaseInfo
 {
-	ByteMark*		mark;
+	ByteMark		mark;
 	int				number;
-	DataBuffer*		data;
+	DataBufferPtr	data;
 };
 
 // _________________________________________________________________________________________________
@@ -138,19 +140,20 @@ struct CaseInfo
 //
 struct ScopeInfo
 {
-	ByteMark*					mark1;
-	ByteMark*					mark2;
+	ByteMark					mark1;
+	ByteMark					mark2;
 	ScopeType					type;
-	DataBuffer*					buffer1;
+	DataBufferPtr				buffer1;
 	int							globalVarIndexBase;
 	int							globalArrayIndexBase;
 	int							localVarIndexBase;
 
 	// switch-related stuff
 	CaseInfo *			casecursor;
+	DataBuffer*					outerSwitchBuffer;
+	bool						isConstantSwitch;
+	int							switchValue;
 	List<CaseInfo>				cases;
-	List<Variable*>				localVariables;
-	List<Variable*>				globalVariables;
 	List<Variable*>				globalArrays;
 };
 
@@ -159,24 +162,29 @@ struct ScopeInfo
 class BotscriptParser
 {
 	PROPERTY (public, bool, isReadOnly, setReadOnly, STOCK_WRITE)
+	PROPERTY (public, bool, isLexerStreaming, setLexerStreaming, STOCK_WRITE)
+	PROPERTY (public, int, lexerThreads, setLexerThreads, STOCK_WRITE)
+	PROPERTY (public, ObjectWriter*, writer, setWriter, STOCK_WRITE)
+	PROPERTY (public, int, optimizationLevel, setOptimizationLevel, STOCK_WRITE)
 
 public:
 	BotscriptParser();
 	~BotscriptParser();
 	void					parseBotscript (String fileName);
-	DataBuffer*				parseCommand (CommandInfo* comm);
-	DataBuffer*				parseAssignment (Variable* var);
+	DataBufferPtr			parseCommand (CommandInfo* comm);
+	DataBufferPtr			parseAssignment (Variable* var);
 	AssignmentOperator		parseAssignmentOperator();
 	String					parseFloat();
 	void					pushScope (bool noreset = false);
-	DataBuffer*				parseStatement();
+	void					popScope();
+	DataBufferPtr			parseStatement();
 	void					addSwitchCase (DataBuffer* b);
 	void					checkToplevel();
 	void					checkNotToplevel();
 	bool					tokenIs (Token a);
 	String					getTokenString();
 	String					describePosition() const;
-	void					writeToFile (String outfile);
+	void					writeToFile();
 	Variable*				findVariable (const String& name);
 	bool					isInGlobalState() const;
 	void					suggestHighestVarIndex (bool global, int index);
@@ -199,19 +207,20 @@ public:
 
 private:
 	// The main buffer - the contents of this is what we
-	// write to file after parsing is complete
-	DataBuffer*		m_mainBuffer;
+	// write to file. It is flushed whenever a state ends.
+	DataBufferPtr	m_mainBuffer;
 
 	// onenter buffer - the contents of the onenter {} block
 	// is buffered here and is merged further at the end of state
-	DataBuffer*		m_onenterBuffer;
+	DataBufferPtr	m_onenterBuffer;
 
 	// Mainloop buffer - the contents of the mainloop {} block
 	// is buffered here and is merged further at the end of state
-	DataBuffer*		m_mainLoopBuffer;
+	DataBufferPtr	m_mainLoopBuffer;
 
 	// Switch buffer - switch case data is recorded to this
-	// buffer initially, instead of into main buffer.
+	// buffer initially, instead of into main buffer. The
+	// buffer itself is owned by the case being recorded.
 	DataBuffer*		m_switchBuffer;
 
 	Lexer*			m_lexer;
@@ -227,6 +236,7 @@ private:
 	int				m_highestStateVarIndex;
 	int				m_numWrittenBytes;
 	List<ScopeInfo>	m_scopeStack;
+	SymbolTable		m_symbols;
 
 	DataBuffer*		currentBuffer();
 	void			parseStateBlock();
@@ -250,9 +260,11 @@ private:
 	void			parseEventdef();
 	void parseFuncdef(bool isBuiltin);
 	void			parseBuiltinDef();
+	void			flushMainBuffer();
 	void			writeMemberBuffers();
 	void			writeStringTable();
-	DataBuffer*		parseExpression (DataType reqtype, bool fromhere = false);
+	DataBufferPtr	parseCondition (int& value, bool istest = true);
+	DataBufferPtr	parseExpression (DataType reqtype, bool fromhere = false);
 	DataHeader		getAssigmentDataHeader (AssignmentOperator op, Variable* var);
 };
 
@@ -0,0 +1,294 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BOTC_REGISTRY_H
+#define BOTC_REGISTRY_H
+
+#include <cstring>
+#include <vector>
+#include "main.h"
+
+// _________________________________________________________________________________________________
+//
+//	A hash table of named items that are found by name regardless of case. Each name is
+//	case-folded once when its item is inserted, so a lookup neither allocates nor folds the names
+//	in the table. Items may also be given a number to be found by.
+//
+//	The tables use open addressing with linear probing, and grow to keep at most half of their
+//	slots in use. The registry does not own its items.
+//
+template<typename T>
+class Registry
+{
+public:
+	Registry();
+
+	void	clear();
+	T*		find (const char* name, int length) const;
+	T*		find (const String& name) const;
+	T*		findByNumber (int number) const;
+	bool	insert (T* item, const String& name);
+	bool	insertNumber (T* item, int number);
+
+	static inline char FoldCase (char ch)
+	{
+		return (ch >= 'a' and ch <= 'z') ? char (ch - 'a' + 'A') : ch;
+	}
+
+private:
+	struct NameSlot
+	{
+		uint32_t	hash;
+		String		foldedName;
+		T*			item;
+	};
+
+	struct NumberSlot
+	{
+		int			number;
+		T*			item;
+	};
+
+	std::vector<NameSlot>	m_names;
+	int						m_numNames;
+	std::vector<NumberSlot>	m_numbers;
+	int						m_numNumbers;
+
+	static uint32_t	HashName (const char* name, int length);
+	static uint32_t	HashNumber (int number);
+	int				findNameSlot (const char* name, int length, uint32_t hash) const;
+	int				findNumberSlot (int number) const;
+	void			growNames();
+	void			growNumbers();
+};
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+Registry<T>::Registry() :
+	m_names (16),
+	m_numNames (0),
+	m_numbers (16),
+	m_numNumbers (0) {}
+
+// _________________________________________________________________________________________________
+//
+//	Removes all items.
+//
+template<typename T>
+void Registry<T>::clear()
+{
+	m_names.assign (16, NameSlot());
+	m_numNames = 0;
+	m_numbers.assign (16, NumberSlot());
+	m_numNumbers = 0;
+}
+
+// _________________________________________________________________________________________________
+//
+//	FNV-1a hash of the case-folded name.
+//
+template<typename T>
+uint32_t Registry<T>::HashName (const char* name, int length)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int i = 0; i < length; ++i)
+	{
+		hash ^= uint8_t (FoldCase (name[i]));
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+uint32_t Registry<T>::HashNumber (int number)
+{
+	uint32_t hash = uint32_t (number) * 2654435761u;
+	return hash ^ (hash >> 16);
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns the slot that has the given name, or the empty slot where it would go.
+//
+template<typename T>
+int Registry<T>::findNameSlot (const char* name, int length, uint32_t hash) const
+{
+	int mask = m_names.size() - 1;
+
+	for (int i = hash & mask;; i = (i + 1) & mask)
+	{
+		const NameSlot& slot = m_names[i];
+
+		if (slot.item == null)
+			return i;
+
+		if (slot.hash != hash or slot.foldedName.length() != length)
+			continue;
+
+		const char* folded = slot.foldedName.c_str();
+		int j = 0;
+
+		while (j < length and FoldCase (name[j]) == folded[j])
+			++j;
+
+		if (j == length)
+			return i;
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+int Registry<T>::findNumberSlot (int number) const
+{
+	int mask = m_numbers.size() - 1;
+
+	for (int i = HashNumber (number) & mask;; i = (i + 1) & mask)
+	{
+		if (m_numbers[i].item == null or m_numbers[i].number == number)
+			return i;
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+T* Registry<T>::find (const char* name, int length) const
+{
+	return m_names[findNameSlot (name, length, HashName (name, length))].item;
+}
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+T* Registry<T>::find (const String& name) const
+{
+	return find (name.c_str(), name.length());
+}
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+T* Registry<T>::findByNumber (int number) const
+{
+	return m_numbers[findNumberSlot (number)].item;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Adds an item by the given name. Returns false if the name is taken, leaving the earlier item
+//	in place.
+//
+template<typename T>
+bool Registry<T>::insert (T* item, const String& name)
+{
+	uint32_t hash = HashName (name.c_str(), name.length());
+	NameSlot& slot = m_names[findNameSlot (name.c_str(), name.length(), hash)];
+
+	if (slot.item != null)
+		return false;
+
+	slot.hash = hash;
+	slot.foldedName = name.toUppercase();
+	slot.item = item;
+
+	if (++m_numNames * 2 > int (m_names.size()))
+		growNames();
+
+	return true;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Adds an item by the given number. Returns false if the number is taken, leaving the earlier
+//	item in place.
+//
+template<typename T>
+bool Registry<T>::insertNumber (T* item, int number)
+{
+	NumberSlot& slot = m_numbers[findNumberSlot (number)];
+
+	if (slot.item != null)
+		return false;
+
+	slot.number = number;
+	slot.item = item;
+
+	if (++m_numNumbers * 2 > int (m_numbers.size()))
+		growNumbers();
+
+	return true;
+}
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+void Registry<T>::growNames()
+{
+	std::vector<NameSlot> old (m_names.size() * 2);
+	old.swap (m_names);
+
+	for (NameSlot& slot : old)
+	{
+		if (slot.item != null)
+		{
+			NameSlot& target = m_names[findNameSlot (slot.foldedName.c_str(),
+				slot.foldedName.length(), slot.hash)];
+			target.hash = slot.hash;
+			target.foldedName = slot.foldedName;
+			target.item = slot.item;
+		}
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+template<typename T>
+void Registry<T>::growNumbers()
+{
+	std::vector<NumberSlot> old (m_numbers.size() * 2);
+	old.swap (m_numbers);
+
+	for (const NumberSlot& slot : old)
+	{
+		if (slot.item != null)
+			m_numbers[findNumberSlot (slot.number)] = slot;
+	}
+}
+
+#endif // BOTC_REGISTRY_H
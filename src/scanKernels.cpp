@@ -0,0 +1,308 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include "main.h"
+#include "scanKernels.h"
+
+#if !defined (BOTC_NO_SIMD) && (defined (__x86_64__) || defined (_M_X64))
+# define BOTC_SCAN_SSE2
+# include <emmintrin.h>
+#endif
+
+#if defined (BOTC_SCAN_SSE2) && defined (__GNUC__)
+# define BOTC_SCAN_AVX2
+# include <immintrin.h>
+#endif
+
+// _________________________________________________________________________________________________
+//
+static inline bool isSpaceCharacter (unsigned char c)
+{
+	return (c == ' ') or (c >= '\t' and c <= '\r');
+}
+
+// _________________________________________________________________________________________________
+//
+static inline bool isSymbolCharacter (unsigned char c)
+{
+	return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9')
+		or (c == '_');
+}
+
+// _________________________________________________________________________________________________
+//
+//	Defines a classifier that tests the block one byte at a time. The test is given the byte as c.
+//
+#define DEFINE_SCALAR_CLASSIFIER(NAME, TEST)									\
+	static uint64_t NAME (const char* block)									\
+	{																			\
+		uint64_t mask = 0;														\
+																				\
+		for (int i = 0; i < ScanBlockSize; ++i)									\
+		{																		\
+			unsigned char c = block[i];											\
+			mask |= uint64_t (TEST) << i;										\
+		}																		\
+																				\
+		return mask;															\
+	}
+
+DEFINE_SCALAR_CLASSIFIER (nonSpacesScalar, not isSpaceCharacter (c))
+DEFINE_SCALAR_CLASSIFIER (nonSymbolsScalar, not isSymbolCharacter (c))
+
+// _________________________________________________________________________________________________
+//
+//	Finds the bytes that equal one of the given characters eight bytes at a time, using the usual
+//	trick for finding zero bytes in a word: the high bit of a byte is carried into only if some
+//	of its lower bits are set. The high bits are then gathered into the lowest byte with a
+//	multiplication.
+//
+template<char... Characters>
+static uint64_t equalBytesScalar (const char* block)
+{
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	uint64_t mask = 0;
+
+	for (int i = 0; i < ScanBlockSize; ++i)
+		for (char c : { Characters... })
+			mask |= uint64_t (block[i] == c) << i;
+
+	return mask;
+#else
+	static const uint64_t lowBits = 0x7F7F7F7F7F7F7F7Full;
+	uint64_t mask = 0;
+
+	for (int i = 0; i < ScanBlockSize; i += 8)
+	{
+		uint64_t word;
+		memcpy (&word, block + i, sizeof word);
+		uint64_t zeros = 0;
+
+		for (char c : { Characters... })
+		{
+			uint64_t y = word ^ (0x0101010101010101ull * (unsigned char) c);
+			zeros |= ~(((y & lowBits) + lowBits) | y) & ~lowBits;
+		}
+
+		mask |= (((zeros >> 7) * 0x0102040810204080ull) >> 56) << i;
+	}
+
+	return mask;
+#endif
+}
+
+static const BlockClassifier ScalarClassifiers[NumCharacterClasses] =
+{
+	&equalBytesScalar<'\n'>,
+	&nonSpacesScalar,
+	&nonSymbolsScalar,
+	&equalBytesScalar<'"', '\\'>,
+	&equalBytesScalar<'*'>,
+};
+
+#ifdef BOTC_SCAN_SSE2
+// _________________________________________________________________________________________________
+//
+//	Byte-wise test for first <= x <= first + span. SSE2 only has signed comparisons, so the range is
+//	moved to start at zero and tested with an unsigned minimum.
+//
+static inline __m128i inRangeSse2 (__m128i x, char first, char span)
+{
+	__m128i moved = _mm_sub_epi8 (x, _mm_set1_epi8 (first));
+	return _mm_cmpeq_epi8 (_mm_min_epu8 (moved, _mm_set1_epi8 (span)), moved);
+}
+
+static inline __m128i equalsSse2 (__m128i x, char c)
+{
+	return _mm_cmpeq_epi8 (x, _mm_set1_epi8 (c));
+}
+
+// _________________________________________________________________________________________________
+//
+//	Defines a classifier that tests 16 bytes at a time. The test is given the bytes as x and
+//	yields 0xFF for each byte that matches. With INVERT set to ~, the mask is inverted.
+//
+#define DEFINE_SSE2_CLASSIFIER(NAME, INVERT, TEST)								\
+	static uint64_t NAME (const char* block)									\
+	{																			\
+		uint64_t mask = 0;														\
+																				\
+		for (int i = 0; i < ScanBlockSize; i += 16)								\
+		{																		\
+			__m128i x = _mm_loadu_si128 (										\
+				reinterpret_cast<const __m128i*> (block + i));					\
+			mask |= uint64_t (uint16_t (INVERT _mm_movemask_epi8 (TEST))) << i;	\
+		}																		\
+																				\
+		return mask;															\
+	}
+
+DEFINE_SSE2_CLASSIFIER (newlinesSse2, , equalsSse2 (x, '\n'))
+DEFINE_SSE2_CLASSIFIER (nonSpacesSse2, ~,
+	_mm_or_si128 (equalsSse2 (x, ' '), inRangeSse2 (x, '\t', '\r' - '\t')))
+DEFINE_SSE2_CLASSIFIER (nonSymbolsSse2, ~,
+	_mm_or_si128 (_mm_or_si128 (
+		inRangeSse2 (_mm_or_si128 (x, _mm_set1_epi8 (0x20)), 'a', 'z' - 'a'),
+		inRangeSse2 (x, '0', '9' - '0')), equalsSse2 (x, '_')))
+DEFINE_SSE2_CLASSIFIER (stringStopsSse2, , _mm_or_si128 (equalsSse2 (x, '"'), equalsSse2 (x, '\\')))
+DEFINE_SSE2_CLASSIFIER (starsSse2, , equalsSse2 (x, '*'))
+
+static const BlockClassifier Sse2Classifiers[NumCharacterClasses] =
+{
+	&newlinesSse2,
+	&nonSpacesSse2,
+	&nonSymbolsSse2,
+	&stringStopsSse2,
+	&starsSse2,
+};
+#endif // BOTC_SCAN_SSE2
+
+#ifdef BOTC_SCAN_AVX2
+// _________________________________________________________________________________________________
+//
+//	The AVX2 classifiers are compiled for AVX2 regardless of the compiler flags, and only used if
+//	the processor turns out to support it.
+//
+__attribute__ ((target ("avx2")))
+static inline __m256i inRangeAvx2 (__m256i x, char first, char span)
+{
+	__m256i moved = _mm256_sub_epi8 (x, _mm256_set1_epi8 (first));
+	return _mm256_cmpeq_epi8 (_mm256_min_epu8 (moved, _mm256_set1_epi8 (span)), moved);
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i equalsAvx2 (__m256i x, char c)
+{
+	return _mm256_cmpeq_epi8 (x, _mm256_set1_epi8 (c));
+}
+
+// _________________________________________________________________________________________________
+//
+#define DEFINE_AVX2_CLASSIFIER(NAME, INVERT, TEST)								\
+	__attribute__ ((target ("avx2")))											\
+	static uint64_t NAME (const char* block)									\
+	{																			\
+		uint64_t mask = 0;														\
+																				\
+		for (int i = 0; i < ScanBlockSize; i += 32)								\
+		{																		\
+			__m256i x = _mm256_loadu_si256 (									\
+				reinterpret_cast<const __m256i*> (block + i));					\
+			mask |= uint64_t (uint32_t (INVERT _mm256_movemask_epi8 (TEST))) << i;	\
+		}																		\
+																				\
+		return mask;															\
+	}
+
+DEFINE_AVX2_CLASSIFIER (newlinesAvx2, , equalsAvx2 (x, '\n'))
+DEFINE_AVX2_CLASSIFIER (nonSpacesAvx2, ~,
+	_mm256_or_si256 (equalsAvx2 (x, ' '), inRangeAvx2 (x, '\t', '\r' - '\t')))
+DEFINE_AVX2_CLASSIFIER (nonSymbolsAvx2, ~,
+	_mm256_or_si256 (_mm256_or_si256 (
+		inRangeAvx2 (_mm256_or_si256 (x, _mm256_set1_epi8 (0x20)), 'a', 'z' - 'a'),
+		inRangeAvx2 (x, '0', '9' - '0')), equalsAvx2 (x, '_')))
+DEFINE_AVX2_CLASSIFIER (stringStopsAvx2, ,
+	_mm256_or_si256 (equalsAvx2 (x, '"'), equalsAvx2 (x, '\\')))
+DEFINE_AVX2_CLASSIFIER (starsAvx2, , equalsAvx2 (x, '*'))
+
+static const BlockClassifier Avx2Classifiers[NumCharacterClasses] =
+{
+	&newlinesAvx2,
+	&nonSpacesAvx2,
+	&nonSymbolsAvx2,
+	&stringStopsAvx2,
+	&starsAvx2,
+};
+#endif // BOTC_SCAN_AVX2
+
+// _________________________________________________________________________________________________
+//
+//	Picks the fastest classifiers that the processor supports. Slower ones can be asked for with
+//	the BOTC_SCAN_KERNEL environment variable ("scalar" or "sse2") to compare them.
+//
+static const BlockClassifier* selectBlockClassifiers()
+{
+	const char* forced = getenv ("BOTC_SCAN_KERNEL");
+	String kernel = (forced != null) ? String (forced).toLowercase() : String ("");
+
+	if (kernel == "scalar")
+		return ScalarClassifiers;
+
+#ifdef BOTC_SCAN_AVX2
+	__builtin_cpu_init();
+
+	if (kernel != "sse2" and __builtin_cpu_supports ("avx2"))
+		return Avx2Classifiers;
+#endif
+
+#ifdef BOTC_SCAN_SSE2
+	return Sse2Classifiers;
+#else
+	return ScalarClassifiers;
+#endif
+}
+
+// _________________________________________________________________________________________________
+//
+const BlockClassifier* getBlockClassifiers()
+{
+	static const BlockClassifier* classifiers = selectBlockClassifiers();
+	return classifiers;
+}
+
+// _________________________________________________________________________________________________
+//
+void findLineBreaks (const char* begin, const char* end, std::vector<uint32_t>& lineBreaks)
+{
+	BlockClassifier classify = getBlockClassifiers()[NewlineCharacters];
+
+	for (const char* block = begin; block < end; block += ScanBlockSize)
+	{
+		uint64_t mask;
+
+		if (end - block >= ScanBlockSize)
+		{
+			mask = classify (block);
+		}
+		else
+		{
+			char padded[ScanBlockSize] = {};
+			memcpy (padded, block, end - block);
+			mask = classify (padded);
+		}
+
+		for (; mask != 0; mask &= mask - 1)
+			lineBreaks.push_back ((block - begin) + countTrailingZeros (mask));
+	}
+}
@@ -0,0 +1,109 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BOTC_SCANKERNELS_H
+#define BOTC_SCANKERNELS_H
+
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+// _________________________________________________________________________________________________
+//
+//	The scanner looks at the source in blocks of 64 bytes. A block is classified into bit masks,
+//	one bit per byte, so that the scanner can find the next byte of interest with a bit scan
+//	instead of looking at the bytes one by one.
+//
+static constexpr int ScanBlockSize = 64;
+
+enum CharacterClass
+{
+	NewlineCharacters,		// '\n'
+	NonSpaceCharacters,		// anything but whitespace
+	NonSymbolCharacters,	// anything but letters, digits and underscores
+	StringStopCharacters,	// '"' and '\\'
+	StarCharacters,			// '*'
+
+	NumCharacterClasses
+};
+
+// Returns the mask of the bytes in the 64-byte block that are of one character class.
+typedef uint64_t (*BlockClassifier) (const char* block);
+
+// Returns the classifiers of each character class, using the fastest instruction set that the
+// processor supports.
+const BlockClassifier* getBlockClassifiers();
+
+// Adds the offsets of the line breaks in the given text to the given list.
+void findLineBreaks (const char* begin, const char* end, std::vector<uint32_t>& lineBreaks);
+
+// _________________________________________________________________________________________________
+//
+inline int countTrailingZeros (uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64 (&index, value);
+	return index;
+#else
+	return __builtin_ctzll (value);
+#endif
+}
+
+// _________________________________________________________________________________________________
+//
+inline int countLeadingZeros (uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64 (&index, value);
+	return 63 - index;
+#else
+	return __builtin_clzll (value);
+#endif
+}
+
+// _________________________________________________________________________________________________
+//
+inline int countOnes (uint64_t value)
+{
+#ifdef _MSC_VER
+	return int (__popcnt64 (value));
+#else
+	return __builtin_popcountll (value);
+#endif
+}
+
+#endif // BOTC_SCANKERNELS_H
@@ -0,0 +1,166 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include "sourceBuffer.h"
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+// _________________________________________________________________________________________________
+//
+SourceBuffer::SourceBuffer (const String& fileName) :
+	m_data (null),
+	m_size (0),
+	m_isMapped (false)
+{
+	static const int chunkSize = 64 * 1024;
+	bool isStdin = (fileName == "-");
+
+#ifndef _WIN32
+	int fd = isStdin ? STDIN_FILENO : open (fileName, O_RDONLY);
+
+	if (fd == -1)
+		error ("couldn't open %1 for reading: %2", fileName, strerror (errno));
+
+	struct stat info;
+
+	if (fstat (fd, &info) == 0 and S_ISREG (info.st_mode) and info.st_size > 0)
+	{
+		void* mapping = mmap (null, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (mapping != MAP_FAILED)
+		{
+			madvise (mapping, info.st_size, MADV_SEQUENTIAL);
+			m_data = static_cast<const char*> (mapping);
+			m_size = info.st_size;
+			m_isMapped = true;
+		}
+	}
+
+	// Not mappable, so read it in chunks until the end of the stream.
+	if (not m_isMapped)
+	{
+		long bytes;
+
+		do
+		{
+			m_storage.resize (m_size + chunkSize);
+			bytes = read (fd, m_storage.data() + m_size, chunkSize);
+
+			if (bytes < 0 and errno != EINTR)
+			{
+				int readerror = errno;
+
+				if (not isStdin)
+					close (fd);
+
+				error ("couldn't read %1: %2", fileName, strerror (readerror));
+			}
+
+			m_size += max (bytes, 0l);
+		} while (bytes != 0);
+	}
+
+	if (not isStdin)
+		close (fd);
+#else
+	FILE* fp = isStdin ? stdin : fopen (fileName, "rb");
+
+	if (fp == null)
+		error ("couldn't open %1 for reading: %2", fileName, strerror (errno));
+
+	long bytes;
+
+	do
+	{
+		m_storage.resize (m_size + chunkSize);
+		bytes = fread (m_storage.data() + m_size, 1, chunkSize, fp);
+		m_size += bytes;
+	} while (bytes == chunkSize);
+
+	if (not isStdin)
+		fclose (fp);
+#endif
+
+	if (not m_isMapped)
+	{
+		m_storage.resize (m_size);
+		m_data = m_storage.data();
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+SourceBuffer::~SourceBuffer()
+{
+#ifndef _WIN32
+	if (m_isMapped)
+		munmap (const_cast<char*> (m_data), m_size);
+#endif
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns a name that is the same for every path that refers to the given file, so that a file
+//	can be recognized however it was named. If the path cannot be resolved, it is returned as is.
+//
+String SourceBuffer::CanonicalPath (const String& fileName)
+{
+	if (fileName == "-")
+		return fileName;
+
+#ifndef _WIN32
+	char* path = realpath (fileName, null);
+#else
+	char* path = _fullpath (null, fileName, 0);
+#endif
+
+	if (path == null)
+		return fileName;
+
+	String result (path);
+	free (path);
+
+#ifdef FILE_CASEINSENSITIVE
+	result = result.toLowercase();
+#endif
+
+	return result;
+}
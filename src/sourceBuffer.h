@@ -0,0 +1,85 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BOTC_SOURCEBUFFER_H
+#define BOTC_SOURCEBUFFER_H
+
+#include <vector>
+#include "main.h"
+
+// _________________________________________________________________________________________________
+//
+//	The SourceBuffer class provides read-only access to the contents of a source file. Regular files
+//	are mapped into memory so that their contents are not copied. Anything that cannot be mapped,
+//	such as pipes or the standard input (given as "-"), is read into memory instead.
+//
+//	The contents are not terminated by a null character; the end of the source is given by end().
+//
+class SourceBuffer
+{
+	DELETE_COPY (SourceBuffer)
+
+public:
+	SourceBuffer (const String& fileName);
+	~SourceBuffer();
+
+	inline const char* begin() const
+	{
+		return m_data;
+	}
+
+	inline const char* end() const
+	{
+		return m_data + m_size;
+	}
+
+	inline long size() const
+	{
+		return m_size;
+	}
+
+	inline bool isMapped() const
+	{
+		return m_isMapped;
+	}
+
+	static String CanonicalPath (const String& fileName);
+
+private:
+	const char*			m_data;
+	long				m_size;
+	bool				m_isMapped;
+	std::vector<char>	m_storage;
+};
+
+#endif // BOTC_SOURCEBUFFER_H
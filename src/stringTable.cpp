@@ -31,9 +31,19 @@
 */
 
 // TODO: Another freeloader...
+#include <vector>
 #include "stringTable.h"
+#include "lexer.h"
 
+// The strings that the script uses, by their number, and the table of the strings that are written
+// to the object file. A string gets its slot in the table when it is placed, which is either as
+// soon as it is seen or once the bytecode that uses it is written. Where each string was first
+// seen is kept for the error of a full table, which may come long after that.
+static StringList g_Strings;
+static std::vector<int> g_Slots;
+static std::vector<SourceLocation> g_Origins;
 static StringList g_StringTable;
+static bool g_IsPlacementDeferred = false;
 
 // _________________________________________________________________________________________________
 //
@@ -44,18 +54,19 @@ const StringList& getStringTable()
 
 // _________________________________________________________________________________________________
 //
-// Potentially adds a string to the table and returns the index of it.
+// Potentially adds a string to the list of strings and returns the number of it. Unless placement
+// is deferred, the string is also placed into the table, and the number is its slot there.
 //
 int getStringTableIndex (const String& a)
 {
-	// Find a free slot in the table.
+	// Find the string among the ones seen so far.
 	int idx;
 
-	for (idx = 0; idx < g_StringTable.size(); idx++)
+	for (idx = 0; idx < g_Strings.size(); idx++)
 	{
-		// String is already in the table, thus return it.
-		if (g_StringTable[idx] == a)
-			return idx;
+		// String is already known, thus return it.
+		if (g_Strings[idx] == a)
+			return g_IsPlacementDeferred ? idx : placeString (idx);
 	}
 
 	// Must not be too long.
@@ -65,13 +76,42 @@ int getStringTableIndex (const String& a)
 			   a, a.length(), Limits::MaxStringLength);
 	}
 
+	Lexer* lx = Lexer::GetCurrentLexer();
+	bool haslocation = (lx != null and lx->hasValidToken());
+	g_Strings.append (a);
+	g_Slots.push_back (-1);
+	g_Origins.push_back (haslocation ? lx->tokenLocation() : SourceLocation());
+	return g_IsPlacementDeferred ? idx : placeString (idx);
+}
+
+// _________________________________________________________________________________________________
+//
+// Puts the string of the given number into the table if it is not there yet, and returns its slot
+// in the table.
+//
+int placeString (int number)
+{
+	if (g_Slots[number] != -1)
+		return g_Slots[number];
+
 	// Check if the table is already full
 	if (g_StringTable.size() == Limits::MaxStringlistSize - 1)
-		error ("too many strings!\n");
+		errorAt (g_Origins[number], "too many strings!\n");
 
 	// Now, dump the string into the slot
-	g_StringTable.append (a);
-	return (g_StringTable.size() - 1);
+	g_StringTable.append (g_Strings[number]);
+	g_Slots[number] = g_StringTable.size() - 1;
+	return g_Slots[number];
+}
+
+// _________________________________________________________________________________________________
+//
+// Sets whether strings are placed into the table only once the bytecode that uses them is written.
+// The optimizer may remove that bytecode, and then the strings take no slots.
+//
+void setStringPlacementDeferred (bool deferred)
+{
+	g_IsPlacementDeferred = deferred;
 }
 
 // _________________________________________________________________________________________________
@@ -82,3 +122,16 @@ int countStringsInTable()
 {
 	return g_StringTable.size();
 }
+
+// _________________________________________________________________________________________________
+//
+// Forgets all strings, for another compilation to start from an empty table.
+//
+void clearStringTable()
+{
+	g_Strings.clear();
+	g_Slots.clear();
+	g_Origins.clear();
+	g_StringTable.clear();
+	g_IsPlacementDeferred = false;
+}
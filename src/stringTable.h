@@ -37,6 +37,9 @@
 
 int getStringTableIndex (const String& a);
 const StringList& getStringTable();
+int placeString (int number);
+void setStringPlacementDeferred (bool deferred);
 int countStringsInTable();
+void clearStringTable();
 
 #endif // BOTC_STRINGTABLE_H
@@ -0,0 +1,185 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "symbolTable.h"
+#include "parser.h"
+
+// _________________________________________________________________________________________________
+//
+SymbolTable::SymbolTable() :
+	m_names (64),
+	m_numNames (0) {}
+
+// _________________________________________________________________________________________________
+//
+uint32_t SymbolTable::HashName (const String& name)
+{
+	uint32_t hash = 2166136261u;
+
+	for (char ch : name)
+	{
+		hash ^= uint8_t (ch);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Returns the slot of the given name, or the empty slot where it would go.
+//
+int SymbolTable::findSlot (const String& name, uint32_t hash) const
+{
+	int mask = m_names.size() - 1;
+
+	for (int i = hash & mask;; i = (i + 1) & mask)
+	{
+		const NameSlot& slot = m_names[i];
+
+		if (slot.isUsed == false or (slot.hash == hash and slot.name == name))
+			return i;
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+void SymbolTable::grow()
+{
+	std::vector<NameSlot> old (m_names.size() * 2);
+	old.swap (m_names);
+
+	for (NameSlot& slot : old)
+	{
+		if (slot.isUsed == false)
+			continue;
+
+		int i = findSlot (slot.name, slot.hash);
+		m_names[i] = slot;
+
+		if (slot.binding != -1)
+		{
+			// Every variable of this name has to know where the name went.
+			for (int j = slot.binding; j != -1; j = m_bindings[j].shadowed)
+				m_bindings[j].slot = i;
+		}
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+void SymbolTable::pushScope()
+{
+	m_scopeStarts.push_back (m_bindings.size());
+}
+
+// _________________________________________________________________________________________________
+//
+//	Closes the innermost scope, forgetting its variables. The variables that they shadowed can be
+//	found again. The variables themselves belong to the compilation's arena.
+//
+void SymbolTable::popScope()
+{
+	ASSERT_EQ (m_scopeStarts.empty(), false);
+	int start = m_scopeStarts.back();
+	m_scopeStarts.pop_back();
+
+	while (int (m_bindings.size()) > start)
+	{
+		Binding& binding = m_bindings.back();
+		m_names[binding.slot].binding = binding.shadowed;
+		m_bindings.pop_back();
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+//	Adds a variable to the innermost scope. The caller must have checked that the scope does not
+//	have a variable of the same name yet.
+//
+void SymbolTable::add (Variable* var)
+{
+	ASSERT_EQ (m_scopeStarts.empty(), false);
+	uint32_t hash = HashName (var->name);
+	int i = findSlot (var->name, hash);
+
+	if (m_names[i].isUsed == false)
+	{
+		if ((m_numNames + 1) * 2 > int (m_names.size()))
+		{
+			grow();
+			i = findSlot (var->name, hash);
+		}
+
+		m_names[i].hash = hash;
+		m_names[i].name = var->name;
+		m_names[i].binding = -1;
+		m_names[i].isUsed = true;
+		m_numNames++;
+	}
+
+	Binding binding = { var, i, m_names[i].binding, int (m_scopeStarts.size()) };
+	m_names[i].binding = m_bindings.size();
+	m_bindings.push_back (binding);
+}
+
+// _________________________________________________________________________________________________
+//
+//	Finds the innermost variable of the given name.
+//
+Variable* SymbolTable::find (const String& name) const
+{
+	const NameSlot& slot = m_names[findSlot (name, HashName (name))];
+
+	if (slot.isUsed == false or slot.binding == -1)
+		return null;
+
+	return m_bindings[slot.binding].variable;
+}
+
+// _________________________________________________________________________________________________
+//
+//	Finds the variable of the given name in the innermost scope only.
+//
+Variable* SymbolTable::findInInnermostScope (const String& name) const
+{
+	const NameSlot& slot = m_names[findSlot (name, HashName (name))];
+
+	if (slot.isUsed == false or slot.binding == -1
+		or m_bindings[slot.binding].depth != int (m_scopeStarts.size()))
+	{
+		return null;
+	}
+
+	return m_bindings[slot.binding].variable;
+}
@@ -0,0 +1,90 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BOTC_SYMBOLTABLE_H
+#define BOTC_SYMBOLTABLE_H
+
+#include <vector>
+#include "main.h"
+
+struct Variable;
+
+// _________________________________________________________________________________________________
+//
+//	The variables that are visible to the parser, by scope. Every name is interned once into a
+//	hash table, whose entry points to the innermost variable of that name. A variable that shadows
+//	another one keeps a link to it, so that closing the scope brings the outer one back into view.
+//
+//	Opening a scope only records where its variables begin; closing it unlinks them.
+//
+class SymbolTable
+{
+	DELETE_COPY (SymbolTable)
+
+public:
+	SymbolTable();
+
+	void		pushScope();
+	void		popScope();
+	void		add (Variable* var);
+	Variable*	find (const String& name) const;
+	Variable*	findInInnermostScope (const String& name) const;
+
+private:
+	struct NameSlot
+	{
+		uint32_t	hash;
+		String		name;
+		int			binding;
+		bool		isUsed;
+	};
+
+	struct Binding
+	{
+		Variable*	variable;
+		int			slot;
+		int			shadowed;
+		int			depth;
+	};
+
+	std::vector<NameSlot>	m_names;
+	int						m_numNames;
+	std::vector<Binding>	m_bindings;
+	std::vector<int>		m_scopeStarts;
+
+	static uint32_t	HashName (const String& name);
+	int				findSlot (const String& name, uint32_t hash) const;
+	void			grow();
+};
+
+#endif // BOTC_SYMBOLTABLE_H
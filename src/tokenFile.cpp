@@ -0,0 +1,272 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include "tokenFile.h"
+#include "sourceBuffer.h"
+
+static const char TokenFileMagic[8] = { 'B', 'O', 'T', 'C', 'T', 'O', 'K', 'S' };
+
+// _________________________________________________________________________________________________
+//
+static inline uint32_t readLittleEndian32 (const char* data)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*> (data);
+	return uint32_t (bytes[0])
+		| (uint32_t (bytes[1]) << 8)
+		| (uint32_t (bytes[2]) << 16)
+		| (uint32_t (bytes[3]) << 24);
+}
+
+// _________________________________________________________________________________________________
+//
+static inline void appendLittleEndian32 (std::string& data, uint32_t value)
+{
+	data += char (value & 0xFF);
+	data += char ((value >> 8) & 0xFF);
+	data += char ((value >> 16) & 0xFF);
+	data += char ((value >> 24) & 0xFF);
+}
+
+// _________________________________________________________________________________________________
+//
+bool TokenFileReader::IsTokenFile (const SourceBuffer& source)
+{
+	return source.size() >= long (sizeof TokenFileMagic)
+		and memcmp (source.begin(), TokenFileMagic, sizeof TokenFileMagic) == 0;
+}
+
+// _________________________________________________________________________________________________
+//
+TokenFileReader::TokenFileReader (const SourceBuffer& source, const String& fileName)
+{
+	const char* position = source.begin() + sizeof TokenFileMagic;
+	const char* end = source.end();
+
+	// Takes the given amount of bytes from the file, or returns null if the file ends before that.
+	auto take = [&](uint64_t bytes) -> const char*
+	{
+		if (uint64_t (end - position) < bytes)
+			return null;
+
+		const char* result = position;
+		position += bytes;
+		return result;
+	};
+
+	const char* header = take (16);
+
+	if (header == null)
+		error ("%1 is not a valid token file: the header is cut short", fileName);
+
+	uint32_t version = readLittleEndian32 (header);
+
+	if (version != TokenFileVersion)
+	{
+		error ("%1 is a token file of version %2, but this " APPNAME " reads version %3",
+			fileName, int (version), int (TokenFileVersion));
+	}
+
+	uint32_t numFiles = readLittleEndian32 (header + 4);
+	uint32_t numTokens = readLittleEndian32 (header + 8);
+	uint32_t poolSize = readLittleEndian32 (header + 12);
+
+	if (numTokens > uint32_t (INT_MAX))
+		error ("%1 is not a valid token file: too many tokens", fileName);
+
+	for (uint32_t i = 0; i < numFiles; ++i)
+	{
+		const char* length = take (4);
+		const char* name = length ? take (readLittleEndian32 (length)) : null;
+
+		if (name == null)
+			error ("%1 is not a valid token file: the file names are cut short", fileName);
+
+		m_fileNames << String (std::string (name, readLittleEndian32 (length)));
+		const char* count = take (4);
+		const char* lineBreaks = count ? take (uint64_t (readLittleEndian32 (count)) * 4) : null;
+
+		if (lineBreaks == null)
+			error ("%1 is not a valid token file: the line breaks are cut short", fileName);
+
+		std::vector<uint32_t> offsets (readLittleEndian32 (count));
+
+		for (size_t j = 0; j < offsets.size(); ++j)
+			offsets[j] = readLittleEndian32 (lineBreaks + j * 4);
+
+		m_lineBreaks << offsets;
+	}
+
+	m_numTokens = numTokens;
+	m_kinds = take (numTokens);
+	m_files = take (uint64_t (numTokens) * 4);
+	m_positions = take (uint64_t (numTokens) * 4);
+	m_offsets = take (uint64_t (numTokens) * 4);
+	m_lengths = take (uint64_t (numTokens) * 4);
+	m_pool = take (poolSize);
+
+	if (m_pool == null)
+		error ("%1 is not a valid token file: the tokens are cut short", fileName);
+
+	for (int i = 0; i < m_numTokens; ++i)
+	{
+		if (uint8_t (m_kinds[i]) >= uint8_t (Token::NumValues)
+			or file (i) >= numFiles
+			or offset (i) > poolSize
+			or length (i) > poolSize - offset (i))
+		{
+			error ("%1 is not a valid token file: token #%2 is broken", fileName, i);
+		}
+	}
+}
+
+// _________________________________________________________________________________________________
+//
+Token TokenFileReader::kind (int index) const
+{
+	return Token (uint8_t (m_kinds[index]));
+}
+
+// _________________________________________________________________________________________________
+//
+uint32_t TokenFileReader::file (int index) const
+{
+	return readLittleEndian32 (m_files + index * 4);
+}
+
+// _________________________________________________________________________________________________
+//
+uint32_t TokenFileReader::position (int index) const
+{
+	return readLittleEndian32 (m_positions + index * 4);
+}
+
+// _________________________________________________________________________________________________
+//
+uint32_t TokenFileReader::offset (int index) const
+{
+	return readLittleEndian32 (m_offsets + index * 4);
+}
+
+// _________________________________________________________________________________________________
+//
+uint32_t TokenFileReader::length (int index) const
+{
+	return readLittleEndian32 (m_lengths + index * 4);
+}
+
+// _________________________________________________________________________________________________
+//
+void TokenFileWriter::addFile (const String& name, const std::vector<uint32_t>& lineBreaks)
+{
+	m_fileNames << name;
+	m_lineBreaks << lineBreaks;
+}
+
+// _________________________________________________________________________________________________
+//
+void TokenFileWriter::addToken (Token kind, uint32_t file, uint32_t position, const String& text)
+{
+	auto it = m_poolOffsets.find (text);
+	uint32_t offset;
+
+	if (it != m_poolOffsets.end())
+	{
+		offset = it->second;
+	}
+	else
+	{
+		offset = m_pool.size();
+		m_pool.append (text.c_str(), text.length());
+		m_poolOffsets[text] = offset;
+	}
+
+	m_kinds.push_back (uint8_t (kind));
+	m_files.push_back (file);
+	m_positions.push_back (position);
+	m_offsets.push_back (offset);
+	m_lengths.push_back (text.length());
+}
+
+// _________________________________________________________________________________________________
+//
+void TokenFileWriter::writeToFile (const String& fileName) const
+{
+	std::string data (TokenFileMagic, sizeof TokenFileMagic);
+	appendLittleEndian32 (data, TokenFileVersion);
+	appendLittleEndian32 (data, m_fileNames.size());
+	appendLittleEndian32 (data, m_kinds.size());
+	appendLittleEndian32 (data, m_pool.size());
+
+	for (int i = 0; i < m_fileNames.size(); ++i)
+	{
+		appendLittleEndian32 (data, m_fileNames[i].length());
+		data.append (m_fileNames[i].c_str(), m_fileNames[i].length());
+		appendLittleEndian32 (data, m_lineBreaks[i].size());
+
+		for (uint32_t offset : m_lineBreaks[i])
+			appendLittleEndian32 (data, offset);
+	}
+
+	data.append (reinterpret_cast<const char*> (m_kinds.data()), m_kinds.size());
+
+	for (uint32_t value : m_files)
+		appendLittleEndian32 (data, value);
+
+	for (uint32_t value : m_positions)
+		appendLittleEndian32 (data, value);
+
+	for (uint32_t value : m_offsets)
+		appendLittleEndian32 (data, value);
+
+	for (uint32_t value : m_lengths)
+		appendLittleEndian32 (data, value);
+
+	data += m_pool;
+	FILE* fp = fopen (fileName, "wb");
+
+	if (fp == null)
+		error ("couldn't open %1 for writing: %2", fileName, strerror (errno));
+
+	if (fwrite (data.data(), 1, data.size(), fp) != data.size())
+	{
+		int writeerror = errno;
+		fclose (fp);
+		error ("couldn't write %1: %2", fileName, strerror (writeerror));
+	}
+
+	fclose (fp);
+	print ("-- %1 token%s1 written to %2\n", int (m_kinds.size()), fileName);
+}
@@ -0,0 +1,143 @@
+/*
+	Copyright 2012-2014 Teemu Piippo
+	Copyright 2019-2020 TarCV
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice,
+	   this list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright
+	   notice, this list of conditions and the following disclaimer in the
+	   documentation and/or other materials provided with the distribution.
+
+	3. Neither the name of the copyright holder nor the names of its
+	   contributors may be used to endorse or promote products derived from this
+	   software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BOTC_TOKENFILE_H
+#define BOTC_TOKENFILE_H
+
+#include <map>
+#include <vector>
+#include "main.h"
+
+class SourceBuffer;
+
+// _________________________________________________________________________________________________
+//
+//	Token files hold a source that has already been lexed, includes and all, so that it can be
+//	compiled without reading the text again. The layout is, all numbers being little-endian:
+//
+//		magic			8 bytes, "BOTCTOKS"
+//		version			uint32, TokenFileVersion
+//		file count		uint32
+//		token count		uint32
+//		string pool		uint32, size in bytes
+//		files			for each file: uint32 length, followed by the name, then uint32 line
+//						break count, followed by the offsets of the line breaks in the file
+//		tokens			the columns of the token table one after another: uint8 kinds, uint32
+//						file indices, uint32 end offsets in the file, uint32 text offsets into the
+//						string pool, uint32 text lengths
+//		string pool		the texts of the tokens
+//
+//	The version must be bumped whenever the Token enumeration changes.
+//
+static constexpr uint32_t TokenFileVersion = 2;
+
+// _________________________________________________________________________________________________
+//
+//	Reads a token file from a source buffer. The contents are checked when the file is opened, and
+//	the tokens are read straight from the buffer.
+//
+class TokenFileReader
+{
+public:
+	TokenFileReader (const SourceBuffer& source, const String& fileName);
+
+	static bool IsTokenFile (const SourceBuffer& source);
+
+	inline int numFiles() const
+	{
+		return m_fileNames.size();
+	}
+
+	inline const String& fileName (int index) const
+	{
+		return m_fileNames[index];
+	}
+
+	inline const std::vector<uint32_t>& lineBreaks (int index) const
+	{
+		return m_lineBreaks[index];
+	}
+
+	inline int numTokens() const
+	{
+		return m_numTokens;
+	}
+
+	inline const char* stringPool() const
+	{
+		return m_pool;
+	}
+
+	Token		kind (int index) const;
+	uint32_t	file (int index) const;
+	uint32_t	position (int index) const;
+	uint32_t	offset (int index) const;
+	uint32_t	length (int index) const;
+
+private:
+	StringList							m_fileNames;
+	List<std::vector<uint32_t>>			m_lineBreaks;
+	int									m_numTokens;
+	const char*							m_kinds;
+	const char*							m_files;
+	const char*							m_positions;
+	const char*							m_offsets;
+	const char*							m_lengths;
+	const char*							m_pool;
+};
+
+// _________________________________________________________________________________________________
+//
+//	Collects tokens and writes them into a token file. Equal token texts share their place in the
+//	string pool.
+//
+class TokenFileWriter
+{
+public:
+	void	addFile (const String& name, const std::vector<uint32_t>& lineBreaks);
+	void	addToken (Token kind, uint32_t file, uint32_t position, const String& text);
+	void	writeToFile (const String& fileName) const;
+
+private:
+	StringList						m_fileNames;
+	List<std::vector<uint32_t>>		m_lineBreaks;
+	std::vector<uint8_t>			m_kinds;
+	std::vector<uint32_t>			m_files;
+	std::vector<uint32_t>			m_positions;
+	std::vector<uint32_t>			m_offsets;
+	std::vector<uint32_t>			m_lengths;
+	std::string						m_pool;
+	std::map<String, uint32_t>		m_poolOffsets;
+};
+
+#endif // BOTC_TOKENFILE_H
@@ -33,6 +33,7 @@
 #ifndef BOTC_TYPES_H
 #define BOTC_TYPES_H
 
+#include <cstdint>
 #include <cstdlib>
 #include <stdexcept>
 #include "macros.h"
@@ -53,18 +54,22 @@ named_enum DataType : char
 
 // _________________________________________________________________________________________________
 //
-struct ByteMark
-{
-	String		name;
-	int			pos;
-};
+// A position in bytecode that references can point to. Marks are numbered from zero up, and the
+// data buffers keep their positions in a table indexed by the number.
+//
+typedef int ByteMark;
+static const ByteMark NoMark = -1;
 
 // _________________________________________________________________________________________________
 //
-struct MarkReference
+// Position of a token in the source. The file is an index into the lexer's file table and the
+// offset is where the token ends in that file. The line and column are only worked out by the lexer
+// when they are needed for a message.
+//
+struct SourceLocation
 {
-	ByteMark*	target;
-	int			pos;
+	uint32_t	file;
+	uint32_t	offset;
 };
 
 // _________________________________________________________________________________________________